@@ -0,0 +1,372 @@
+#include "netscheduler.h"
+
+// binding: once the schedule is fixed, every add and multiply is assigned
+// to one instance of its unit, and every value that is still needed after
+// the cycle it's produced in to a register.  each operand port of a unit,
+// and the input of each register, is multiplexed between all the sources
+// it takes over the schedule, and with many units that fan-in is what
+// limits the clock, so both are bound to add as few mux inputs as possible.
+//
+// registers are allocated by the left-edge algorithm: values in order of
+// their birth, each into a register whose last value is dead by then, and
+// into a new one only if there is none, which takes no more registers than
+// are ever live at once.  operations are bound in start order to an
+// instance that's free in all the cycles they occupy it (or slots of the
+// initiation interval).  among the free registers and instances, the one
+// whose muxes already take the sources wins, trying both operand orders of
+// two-input operations.  a value is read straight off its unit in the
+// cycle it's produced, and from its register after that, as in
+// count_registers().  under an initiation interval, the values of
+// consecutive samples overlap in rotating registers, which aren't modeled:
+// values are then only named
+
+// operand sources
+enum {SOURCE_REGISTER,SOURCE_ADDER,SOURCE_MULTIPLIER,SOURCE_NODE};
+#define SOURCE(kind,index)		(((kind) << 28) | (index))
+#define SOURCE_KIND(source)		((source) >> 28)
+#define SOURCE_INDEX(source)	((source) & 0x0fffffff)
+
+// the distinct sources of a mux
+typedef struct {
+	int *inputs;
+	int count,max;
+} mux;
+
+static int mux_has (const mux *m,int source) {
+	for (int i=0;i<m->count;i++) if (m->inputs[i] == source) return 1;
+	
+	return 0;
+}
+
+static void mux_add (mux *m,int source) {
+	if (mux_has(m,source)) return;
+	
+	if (m->count == m->max) {
+		m->max = m->max ? 2*m->max : 4;
+		m->inputs = (int *)realloc(m->inputs,sizeof(int)*m->max);
+		if (!m->inputs) {
+			perror("Fatal: growing multiplexer inputs");
+			exit(1);
+		}
+	}
+	m->inputs[m->count++] = source;
+}
+
+// mux inputs added by taking a source (a single input is just a wire)
+static int mux_cost (const mux *m,int source) {
+	if (!m->count || mux_has(m,source)) return 0;
+	
+	return m->count == 1 ? 2 : 1;
+}
+
+// start cycle first, topological position second
+static int compare_keys (const void *a,const void *b) {
+	int64_t x = *(const int64_t *)a;
+	int64_t y = *(const int64_t *)b;
+	
+	return x < y ? -1 : x > y;
+}
+
+// the node's result, straight off the unit that computes it
+static int unit_source (binding *mybinding,node *mynode) {
+	if (mynode->type == ADD) return SOURCE(SOURCE_ADDER,mybinding->unit[mynode->index]);
+	if (mynode->type == MULT) return SOURCE(SOURCE_MULTIPLIER,mybinding->unit[mynode->index]);
+	
+	return SOURCE(SOURCE_NODE,mynode->index);
+}
+
+// the node's result, as read in a cycle
+static int value_source (binding *mybinding,node *mynode,int cycle) {
+	if (cycle <= mynode->scheduled_cycle + NODE_LATENCY(mynode)) return unit_source(mybinding,mynode);
+	if (mybinding->reg[mynode->index] >= 0) return SOURCE(SOURCE_REGISTER,mybinding->reg[mynode->index]);
+	
+	return SOURCE(SOURCE_NODE,mynode->index);
+}
+
+static void source_name (binding *mybinding,int source,char *str,int len) {
+	node *mynode = &mybinding->mydag->nodes[SOURCE_INDEX(source)];
+	
+	switch (SOURCE_KIND(source)) {
+		case SOURCE_REGISTER: snprintf(str,len,"reg%d",SOURCE_INDEX(source)); break;
+		case SOURCE_ADDER: snprintf(str,len,"adder%d",SOURCE_INDEX(source)); break;
+		case SOURCE_MULTIPLIER: snprintf(str,len,"mult%d",SOURCE_INDEX(source)); break;
+		default: snprintf(str,len,"%s%d",NODETYPE_CODE(mynode->type),mynode->id);
+	}
+}
+
+// bind the DAG's schedule (in the nodes' scheduled cycles) onto as many
+// instances of each unit as it keeps busy at once (or, under an initiation
+// interval, a few more if the occupancies don't nest), and onto registers
+// (see above)
+binding *bind_schedule (dag *mydag,int num_adders,int num_multipliers) {
+	int n = mydag->num_nodes;
+	node_idx *order = topological_order(mydag);
+	binding *mybinding = (binding *)malloc(sizeof(binding));
+	int *until = (int *)malloc(sizeof(int)*(n ? n : 1));
+	int64_t *ops = (int64_t *)malloc(sizeof(int64_t)*(n ? n : 1));
+	int64_t *values = (int64_t *)malloc(sizeof(int64_t)*(n ? n : 1));
+	int num_values=0,max_cycle=0;
+	
+	mybinding->mydag = mydag;
+	mybinding->unit = (int *)malloc(sizeof(int)*(n ? n : 1));
+	mybinding->reg = (int *)malloc(sizeof(int)*(n ? n : 1));
+	mybinding->source = (int *)malloc(sizeof(int)*(mydag->in_offset[n] ? mydag->in_offset[n] : 1));
+	mybinding->num_registers = 0;
+	mybinding->mux_inputs = 0;
+	mybinding->max_fan_in = 0;
+	
+	// the cycle each value is held until (its last consumer's start)
+	for (int i=0;i<n;i++) {
+		node *mynode = &mydag->nodes[i];
+		
+		mybinding->unit[i] = mybinding->reg[i] = -1;
+		until[i] = -1;
+		for (int j=0;j<NUM_OUT_EDGES(mynode);j++)
+			if (OUT_NODE(mynode,j)->scheduled_cycle > until[i]) until[i] = OUT_NODE(mynode,j)->scheduled_cycle;
+		
+		if (mynode->scheduled_cycle + NODE_LATENCY(mynode) > max_cycle) max_cycle = mynode->scheduled_cycle + NODE_LATENCY(mynode);
+	}
+	
+	// operations by start, values by birth
+	for (int i=0;i<n;i++) {
+		node *mynode = &mydag->nodes[order[i]];
+		int born = mynode->scheduled_cycle + NODE_LATENCY(mynode);
+		
+		ops[i] = ((int64_t)mynode->scheduled_cycle << 32) | i;
+		if (until[order[i]] > born) values[num_values++] = ((int64_t)born << 32) | i;
+	}
+	qsort(ops,n,sizeof(int64_t),compare_keys);
+	qsort(values,num_values,sizeof(int64_t),compare_keys);
+	
+	// as many instances as are busy at once, with a mux per operand port
+	int busy_cycle = max_cycle + (OCCUPANCY(ADD) > OCCUPANCY(MULT) ? OCCUPANCY(ADD) : OCCUPANCY(MULT));
+	int slots = RESOURCE_SLOTS(busy_cycle);
+	int *add_use = (int *)calloc(slots,sizeof(int));
+	int *mult_use = (int *)calloc(slots,sizeof(int));
+	int add_ports=0,mult_ports=0;
+	
+	mybinding->num_adders = mybinding->num_multipliers = 0;
+	for (int i=0;i<n;i++) {
+		node *mynode = &mydag->nodes[i];
+		
+		if (mynode->type == ADD) {
+			occupy_unit(add_use,ADD,schedule_ii,mynode->scheduled_cycle,1);
+			if (NUM_IN_EDGES(mynode) > add_ports) add_ports = NUM_IN_EDGES(mynode);
+		} else if (mynode->type == MULT) {
+			occupy_unit(mult_use,MULT,schedule_ii,mynode->scheduled_cycle,1);
+			if (NUM_IN_EDGES(mynode) > mult_ports) mult_ports = NUM_IN_EDGES(mynode);
+		}
+	}
+	for (int c=0;c<slots;c++) {
+		if (add_use[c] > mybinding->num_adders) mybinding->num_adders = add_use[c];
+		if (mult_use[c] > mybinding->num_multipliers) mybinding->num_multipliers = mult_use[c];
+	}
+	
+	if (mybinding->num_adders > num_adders || mybinding->num_multipliers > num_multipliers) {
+		fprintf(stderr,"Fatal: the schedule keeps up to %d adders and %d multipliers busy at once, but there are %d adders and %d multipliers.\n",
+				mybinding->num_adders,mybinding->num_multipliers,num_adders,num_multipliers);
+		exit(1);
+	}
+	
+	// an instance can't hold an operation for longer than the initiation
+	// interval, since the next sample's would start on it before it's done
+	if (schedule_ii && ((mybinding->num_adders && OCCUPANCY(ADD) > schedule_ii) || (mybinding->num_multipliers && OCCUPANCY(MULT) > schedule_ii))) {
+		fprintf(stderr,"Fatal: units that are busy longer than the initiation interval of %d cycles can't be bound.\n",schedule_ii);
+		exit(1);
+	}
+	
+	// room for every unit, as occupancies that wrap around the interval
+	// may not fit on the busiest slot's count of instances
+	char *add_busy = (char *)calloc(num_adders*slots+1,1);
+	char *mult_busy = (char *)calloc(num_multipliers*slots+1,1);
+	mux *add_mux = (mux *)calloc(num_adders*add_ports+1,sizeof(mux));
+	mux *mult_mux = (mux *)calloc(num_multipliers*mult_ports+1,sizeof(mux));
+	mux *reg_mux = NULL;
+	int *reg_free = NULL;
+	int max_registers=0;
+	
+	// operations before the values born in their cycle (whose producers
+	// must be bound), values before the operations that read them later
+	for (int p=0,q=0;p<n || q<num_values;) {
+		if (p < n && (q == num_values || (ops[p] >> 32) <= (values[q] >> 32))) {
+			node *mynode = &mydag->nodes[order[ops[p++] & 0xffffffff]];
+			int *source = &mybinding->source[mydag->in_offset[mynode->index]];
+			int num_ports = NUM_IN_EDGES(mynode);
+			
+			for (int j=0;j<num_ports;j++) source[j] = value_source(mybinding,IN_NODE(mynode,j),mynode->scheduled_cycle);
+			
+			if (mynode->type != ADD && mynode->type != MULT) continue;
+			
+			int *instances = mynode->type == ADD ? &mybinding->num_adders : &mybinding->num_multipliers;
+			int num_units = mynode->type == ADD ? num_adders : num_multipliers;
+			int ports = mynode->type == ADD ? add_ports : mult_ports;
+			char *busy = mynode->type == ADD ? add_busy : mult_busy;
+			mux *muxes = mynode->type == ADD ? add_mux : mult_mux;
+			int occupancy = OCCUPANCY(mynode->type);
+			int best=-1,best_cost=0,best_swap=0;
+			
+			for (int u=0;u<*instances;u++) {
+				int k;
+				for (k=0;k<occupancy && !busy[u*slots+RESOURCE_SLOT(mynode->scheduled_cycle+k)];k++);
+				if (k < occupancy) continue;
+				
+				for (int swap=0;swap<=(num_ports == 2);swap++) {
+					int cost=0;
+					
+					for (int j=0;j<num_ports;j++) cost += mux_cost(&muxes[u*ports+j],source[j^swap]);
+					if (best < 0 || cost < best_cost) {
+						best = u;
+						best_cost = cost;
+						best_swap = swap;
+					}
+				}
+			}
+			
+			// all taken, so open another one
+			if (best < 0) {
+				if (*instances == num_units) {
+					fprintf(stderr,"Fatal: no free %s for node %d in cycle %d.\n",mynode->type == ADD ? "adder" : "multiplier",mynode->id,mynode->scheduled_cycle);
+					exit(1);
+				}
+				best = (*instances)++;
+			}
+			
+			if (best_swap) {
+				int t = source[0];
+				source[0] = source[1];
+				source[1] = t;
+			}
+			
+			for (int k=0;k<occupancy;k++) busy[best*slots+RESOURCE_SLOT(mynode->scheduled_cycle+k)] = 1;
+			mybinding->unit[mynode->index] = best;
+			for (int j=0;j<num_ports;j++) mux_add(&muxes[best*ports+j],source[j]);
+		} else {
+			node *mynode = &mydag->nodes[order[values[q++] & 0xffffffff]];
+			int born = mynode->scheduled_cycle + NODE_LATENCY(mynode);
+			int source = unit_source(mybinding,mynode);
+			int best=-1,best_cost=0;
+			
+			if (schedule_ii) continue;
+			
+			for (int r=0;r<mybinding->num_registers;r++) {
+				if (reg_free[r] > born) continue;
+				
+				int cost = mux_cost(&reg_mux[r],source);
+				if (best < 0 || cost < best_cost) {
+					best = r;
+					best_cost = cost;
+				}
+			}
+			
+			if (best < 0) {
+				if (mybinding->num_registers == max_registers) {
+					max_registers = max_registers ? 2*max_registers : 64;
+					reg_mux = (mux *)realloc(reg_mux,sizeof(mux)*max_registers);
+					reg_free = (int *)realloc(reg_free,sizeof(int)*max_registers);
+					if (!reg_mux || !reg_free) {
+						perror("Fatal: growing register file");
+						exit(1);
+					}
+				}
+				best = mybinding->num_registers++;
+				memset(&reg_mux[best],0,sizeof(mux));
+			}
+			
+			reg_free[best] = until[mynode->index];
+			mybinding->reg[mynode->index] = best;
+			mux_add(&reg_mux[best],source);
+		}
+	}
+	
+	// count the inputs of the real muxes
+	mux *all[3] = {add_mux,mult_mux,reg_mux};
+	int counts[3] = {mybinding->num_adders*add_ports,mybinding->num_multipliers*mult_ports,mybinding->num_registers};
+	for (int k=0;k<3;k++) {
+		for (int i=0;i<counts[k];i++) {
+			if (all[k][i].count > 1) mybinding->mux_inputs += all[k][i].count;
+			if (all[k][i].count > mybinding->max_fan_in) mybinding->max_fan_in = all[k][i].count;
+			free(all[k][i].inputs);
+		}
+	}
+	
+	free(until);
+	free(ops);
+	free(values);
+	free(add_use);
+	free(mult_use);
+	free(add_busy);
+	free(mult_busy);
+	free(add_mux);
+	free(mult_mux);
+	free(reg_mux);
+	free(reg_free);
+	
+	return mybinding;
+}
+
+// write the binding as a table, one row per node in start order: its
+// unit instance and register (if any) and the source of each operand port
+void write_binding (binding *mybinding,const char *filename) {
+	dag *mydag = mybinding->mydag;
+	int n = mydag->num_nodes;
+	node_idx *order = topological_order(mydag);
+	int64_t *keys = (int64_t *)malloc(sizeof(int64_t)*(n ? n : 1));
+	int max_ports=0;
+	char str[1024];
+	
+	FILE *myFile = fopen(filename,"w+");
+	if (!myFile) {
+		snprintf(str,1024,"ERROR opening \"%s\" for write",filename);
+		perror(str);
+		exit(1);
+	}
+	
+	for (int i=0;i<n;i++) {
+		keys[i] = ((int64_t)mydag->nodes[order[i]].scheduled_cycle << 32) | i;
+		if (NUM_IN_EDGES(&mydag->nodes[i]) > max_ports) max_ports = NUM_IN_EDGES(&mydag->nodes[i]);
+	}
+	qsort(keys,n,sizeof(int64_t),compare_keys);
+	
+	fprintf(myFile,"\"node\",\"op\",\"cycle\",\"unit\",\"register\"");
+	for (int j=0;j<max_ports;j++) fprintf(myFile,",\"port%d\"",j);
+	fprintf(myFile,"\n");
+	
+	for (int i=0;i<n;i++) {
+		node *mynode = &mydag->nodes[order[keys[i] & 0xffffffff]];
+		
+		fprintf(myFile,"\"%d\",\"%s\",\"%d\",",mynode->id,NODETYPE(mynode->type),mynode->scheduled_cycle);
+		
+		if (mybinding->unit[mynode->index] >= 0) {
+			source_name(mybinding,unit_source(mybinding,mynode),str,1024);
+			fprintf(myFile,"\"%s\",",str);
+		} else {
+			fprintf(myFile,"\"\",");
+		}
+		
+		if (mybinding->reg[mynode->index] >= 0) {
+			fprintf(myFile,"\"reg%d\"",mybinding->reg[mynode->index]);
+		} else {
+			fprintf(myFile,"\"\"");
+		}
+		
+		for (int j=0;j<max_ports;j++) {
+			if (j < NUM_IN_EDGES(mynode)) {
+				source_name(mybinding,mybinding->source[mydag->in_offset[mynode->index]+j],str,1024);
+				fprintf(myFile,",\"%s\"",str);
+			} else {
+				fprintf(myFile,",\"\"");
+			}
+		}
+		fprintf(myFile,"\n");
+	}
+	
+	fclose(myFile);
+	free(keys);
+}
+
+void free_binding (binding *mybinding) {
+	free(mybinding->unit);
+	free(mybinding->reg);
+	free(mybinding->source);
+	free(mybinding);
+}
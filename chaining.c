@@ -0,0 +1,62 @@
+#include "netscheduler.h"
+
+// operation chaining: the units' latencies are whole cycles, but an
+// operation whose combinational delay is a fraction of the clock period can
+// hand its result to the operations it feeds within the same cycle.
+// chain_operations() decides this per node, so that the delays along any
+// path of chained nodes, plus that of the node the path ends in, add up to
+// no more than CLOCK_PERIOD.  a chained node's successors may then start in
+// its own cycle (see NODE_LATENCY()), whichever cycles the schedulers pick.
+// register lifetimes start NODE_LATENCY() cycles after the producer's start
+// too, so a value only consumed in its own cycle takes no register
+
+// combinational delay of each node type in ns (0 for none), indexed by
+// node_type (INPUT,MULT,ADD,OUTPUT,ADDBIAS)
+double node_delay[] = {0.0,DELAY_MULTIPLIER,DELAY_ADDER,0.0,DELAY_ADDER};
+
+// whether a node's operation is combinational within one cycle, so it can
+// be chained into, and out of
+static int chainable (node *mynode) {
+	double delay = node_delay[mynode->type];
+	
+	return delay > 0.0 && delay <= CLOCK_PERIOD && LATENCY(mynode->type) == 1;
+}
+
+// mark the nodes that are chained into their successors.  in topological
+// order, a node's arrival is the delay from the last register to its
+// result: its own delay, after the latest arrival of its chained operands.
+// it's chained if all its successors can be, and the slowest of them still
+// finishes within the period.  returns the number of chained nodes
+int chain_operations (dag *mydag) {
+	int n = mydag->num_nodes;
+	node_idx *order = topological_order(mydag);
+	double *arrival = (double *)malloc(sizeof(double)*(n ? n : 1));
+	int num_chained=0;
+	
+	for (int i=0;i<n;i++) {
+		node *mynode = &mydag->nodes[order[i]];
+		double delay = node_delay[mynode->type];
+		double slowest=0.0;
+		int chain = chainable(mynode) && NUM_OUT_EDGES(mynode);
+		
+		arrival[mynode->index] = delay;
+		for (int j=0;j<NUM_IN_EDGES(mynode);j++) {
+			node *pred = IN_NODE(mynode,j);
+			if (pred->chained && arrival[pred->index] + delay > arrival[mynode->index]) arrival[mynode->index] = arrival[pred->index] + delay;
+		}
+		
+		for (int j=0;j<NUM_OUT_EDGES(mynode) && chain;j++) {
+			node *succ = OUT_NODE(mynode,j);
+			
+			if (!chainable(succ)) chain=0;
+			else if (node_delay[succ->type] > slowest) slowest = node_delay[succ->type];
+		}
+		
+		mynode->chained = chain && arrival[mynode->index] + slowest <= CLOCK_PERIOD;
+		if (mynode->chained) num_chained++;
+	}
+	
+	free(arrival);
+	
+	return num_chained;
+}
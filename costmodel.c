@@ -0,0 +1,120 @@
+#include "netscheduler.h"
+
+// operator cost model: the latency, delay and DSP/LUT cost of the adder and
+// multiplier depend on the width and kind of the data, so that narrow fixed
+// point schedules on as many units as the device really holds.  the entries
+// are those Vitis HLS picks for a 7-series device at 200 MHz.  fixed point
+// adds are LUT carry chains, multiplies up to 18 bits take one DSP48 (and up
+// to 8 bits two of them share one, as a neuron input's multiplies by their
+// weights can), wider ones several, floating point operators are pipelined
+// cores on DSPs and LUTs
+
+// the cheapest implementation first, for each type and kind of data
+static const operator_cost operator_costs[] = {
+	// type, floating, max_width, latency, delay, dsps, luts, packing
+	{ADD,0,8,0,1.2,0,8,1},
+	{ADD,0,16,0,1.6,0,16,1},
+	{ADD,0,32,0,2.4,0,32,1},
+	{ADD,0,64,0,3.6,0,64,1},
+	{MULT,0,8,0,3.4,1,0,2},
+	{MULT,0,18,0,3.9,1,0,1},
+	{MULT,0,25,2,0.0,2,0,1},
+	{MULT,0,35,3,0.0,4,0,1},
+	{MULT,0,64,6,0.0,16,0,1},
+	{ADD,1,16,3,0.0,2,120,1},
+	{ADD,1,32,4,0.0,2,220,1},
+	{ADD,1,64,5,0.0,3,650,1},
+	{MULT,1,16,2,0.0,1,40,1},
+	{MULT,1,32,3,0.0,3,70,1},
+	{MULT,1,64,6,0.0,11,200,1}
+};
+
+#define NUM_OPERATOR_COSTS	((int)(sizeof(operator_costs)/sizeof(operator_cost)))
+
+// width and kind of a datatype: "float", "double", "half", or an
+// ap_fixed/ap_ufixed/ap_int/ap_uint with its width as the first parameter
+static void parse_datatype (const char *datatype,int *width,int *floating) {
+	const char *params = strchr(datatype,'<');
+	
+	*floating = 1;
+	if (!strcmp(datatype,"float")) *width = 32; else
+	if (!strcmp(datatype,"double")) *width = 64; else
+	if (!strcmp(datatype,"half")) *width = 16; else {
+		*floating = 0;
+		if (strncmp(datatype,"ap_",3) || !params || sscanf(params+1,"%d",width) != 1 || *width < 1) {
+			fprintf(stderr,"Fatal: no cost model for datatype \"%s\".\n",datatype);
+			exit(1);
+		}
+	}
+}
+
+// the cheapest implementation of an ADD or MULT for the datatype
+const operator_cost *find_operator_cost (node_type type,const char *datatype) {
+	int width,floating;
+	
+	parse_datatype(datatype,&width,&floating);
+	for (int i=0;i<NUM_OPERATOR_COSTS;i++) {
+		const operator_cost *cost = &operator_costs[i];
+		if (cost->type == type && cost->floating == floating && cost->max_width >= width) return cost;
+	}
+	
+	fprintf(stderr,"Fatal: no %s wide enough for datatype \"%s\".\n",NODETYPE(type),datatype);
+	exit(1);
+}
+
+// set the latency and delay models (and the ADDBIAS nodes', which share the
+// adder) for the datatype.  a combinational operator takes the cycles its
+// delay spans, and can be chained (see chain_operations()).  must be called
+// before the DAG's timing is computed
+void apply_cost_model (const char *datatype) {
+	const operator_cost *adder = find_operator_cost(ADD,datatype);
+	const operator_cost *multiplier = find_operator_cost(MULT,datatype);
+	
+	node_latency[ADD] = node_latency[ADDBIAS] = adder->latency ? adder->latency : DELAY_CYCLES(adder->delay);
+	node_latency[MULT] = multiplier->latency ? multiplier->latency : DELAY_CYCLES(multiplier->delay);
+	node_delay[ADD] = node_delay[ADDBIAS] = adder->latency ? 0.0 : adder->delay;
+	node_delay[MULT] = multiplier->latency ? 0.0 : multiplier->delay;
+	
+	logmsg("Cost model for %s: adder %d cycles (%d DSPs, %d LUTs), multiplier %d cycles (%d DSPs, %d LUTs, %d per unit)",
+			datatype,node_latency[ADD],adder->dsps,adder->luts,node_latency[MULT],multiplier->dsps,multiplier->luts,multiplier->packing);
+}
+
+// turn the DSP and LUT budget into adders and multipliers for num_adds ADD
+// and num_mults MULT operations of the datatype: unit instances are added
+// one at a time, to the type whose units cover the smallest share of its
+// operations, while the budget holds them.  a packed instance counts as
+// packing units
+void budget_units (int num_adds,int num_mults,const char *datatype,int dsp_budget,int lut_budget,int *num_adders,int *num_multipliers) {
+	const operator_cost *cost[2] = {find_operator_cost(ADD,datatype),find_operator_cost(MULT,datatype)};
+	int ops[2] = {num_adds,num_mults},units[2] = {0,0};
+	int dsps=0,luts=0;
+	
+	for (;;) {
+		int best=-1;
+		
+		for (int k=0;k<2;k++) {
+			if (units[k] >= ops[k] || dsps + cost[k]->dsps > dsp_budget || luts + cost[k]->luts > lut_budget) continue;
+			if (best < 0 || (long)units[k]*ops[best] < (long)units[best]*ops[k]) best = k;
+		}
+		if (best < 0) break;
+		
+		units[best] += cost[best]->packing;
+		dsps += cost[best]->dsps;
+		luts += cost[best]->luts;
+	}
+	
+	for (int k=0;k<2;k++) {
+		if (ops[k] && !units[k]) {
+			fprintf(stderr,"Fatal: the budget of %d DSPs and %d LUTs holds no %s for datatype \"%s\".\n",
+					dsp_budget,lut_budget,NODETYPE(cost[k]->type),datatype);
+			exit(1);
+		}
+		if (units[k] > ops[k]) units[k] = ops[k];
+	}
+	
+	*num_adders = units[0];
+	*num_multipliers = units[1];
+	
+	logmsg("Budget of %d DSPs and %d LUTs: %d adders, %d multipliers (%d DSPs, %d LUTs used)",
+			dsp_budget,lut_budget,*num_adders,*num_multipliers,dsps,luts);
+}
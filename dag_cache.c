@@ -0,0 +1,372 @@
+#include "netscheduler.h"
+
+// on-disk layout of a cached DAG: a fixed header followed by 8-byte aligned
+// sections.  everything except the nodes is stored exactly as it is held in
+// memory, so those sections are used in place from the mapping.  nodes hold
+// pointers, so they are stored with indices and re-linked on load
+#define DAG_FILE_MAGIC		"NSDAG\0\0\0"
+#define DAG_FILE_VERSION	2
+#define DAG_FILE_NONE		((node_idx)-1)
+
+enum {
+	SECTION_NODES,
+	SECTION_EDGE_PRED,
+	SECTION_EDGE_SUCC,
+	SECTION_EDGE_INPUT_NUM,
+	SECTION_IN_OFFSET,
+	SECTION_IN_EDGE_LIST,
+	SECTION_OUT_OFFSET,
+	SECTION_OUT_EDGE_LIST,
+	SECTION_TOPO_ORDER,
+	SECTION_LEVEL_OFFSET,
+	SECTION_NODE_LEVEL,
+	SECTION_LAYER_SIZE,
+	SECTION_LAYER_NODES,
+	SECTION_LAYERS,
+	NUM_SECTIONS
+};
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t node_record_size;
+	uint32_t edge_record_size;
+	uint64_t topology_hash;
+	uint64_t timing_hash;
+	int32_t num_nodes;
+	int32_t num_edges;
+	int32_t num_layers;
+	int32_t num_levels;
+	int32_t timed;
+	int32_t reserved;
+	uint64_t section_offset[NUM_SECTIONS];
+	uint64_t file_size;
+} dag_file_header;
+
+typedef struct {
+	int32_t id;
+	int32_t type;
+	int32_t asap_cycle;
+	int32_t alap_cycle;
+	int32_t scheduled_cycle;
+	int32_t layer;
+	int32_t input_number;
+	int32_t neuron;
+	int32_t final_adder;
+	int32_t delta_multiplier;
+	int32_t chained;
+	node_idx next;
+	node_idx prev;
+} dag_file_node;
+
+// FNV-1a over a sequence of ints
+static uint64_t hash_ints (uint64_t hash,const int *values,int n) {
+	const unsigned char *bytes = (const unsigned char *)values;
+	
+	for (size_t i=0;i<n*sizeof(int);i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+	
+	return hash;
+}
+
+// everything that decides the shape of the DAG built by create_basic_network_dag()
+static uint64_t topology_hash (int num_layers,int *layer_sizes,int inc_bias,int inc_delta_multiplier) {
+	int params[] = {DAG_FILE_VERSION,num_layers,inc_bias,inc_delta_multiplier,
+#ifdef BINARY_ADDER
+					1
+#else
+					0
+#endif
+	};
+	
+	uint64_t hash = hash_ints(0xcbf29ce484222325ULL,params,sizeof(params)/sizeof(int));
+	return hash_ints(hash,layer_sizes,num_layers);
+}
+
+// everything that decides the ASAP/ALAP windows of a given DAG
+static uint64_t timing_hash (void) {
+	int params[] = {schedule_slack,schedule_max_ii,
+#ifdef CHAIN_OPERATIONS
+					1,(int)(CLOCK_PERIOD*1000),(int)(node_delay[MULT]*1000),(int)(node_delay[ADD]*1000)
+#else
+					0
+#endif
+	};
+	
+	uint64_t hash = hash_ints(0xcbf29ce484222325ULL,node_latency,ADDBIAS+1);
+	return hash_ints(hash,params,sizeof(params)/sizeof(int));
+}
+
+static void write_section (FILE *myFile,dag_file_header *header,int section,const void *data,size_t size) {
+	static const char padding[8] = {0};
+	long offset = ftell(myFile);
+	
+	if (offset & 7) {
+		fwrite(padding,1,8-(offset&7),myFile);
+		offset += 8-(offset&7);
+	}
+	
+	header->section_offset[section] = offset;
+	if (size && fwrite(data,1,size,myFile) != size) {
+		perror("Fatal: writing DAG cache");
+		exit(1);
+	}
+}
+
+void save_dag (node **layers,const char *filename,int num_layers,int *layer_sizes,int inc_bias,int inc_delta_multiplier) {
+	dag *mydag = layers[0]->graph;
+	dag_file_header header;
+	char tmp_filename[1024],str[1024];
+	
+	// make sure the derived structures are current, since they are stored too
+	node_idx *order = topological_order(mydag);
+	
+	memset(&header,0,sizeof(header));
+	memcpy(header.magic,DAG_FILE_MAGIC,8);
+	header.version = DAG_FILE_VERSION;
+	header.byte_order = 0x01020304;
+	header.node_record_size = sizeof(dag_file_node);
+	header.edge_record_size = sizeof(edge);
+	header.topology_hash = topology_hash(num_layers,layer_sizes,inc_bias,inc_delta_multiplier);
+	header.timing_hash = timing_hash();
+	header.num_nodes = mydag->num_nodes;
+	header.num_edges = mydag->num_edges;
+	header.num_layers = mydag->num_layers;
+	header.num_levels = mydag->num_levels;
+	header.timed = mydag->timed;
+	
+	// write to a temporary file and rename it into place, so a mapping of the
+	// previous version stays valid
+	snprintf(tmp_filename,1024,"%s.tmp",filename);
+	FILE *myFile = fopen(tmp_filename,"w+");
+	if (!myFile) {
+		snprintf(str,1024,"ERROR: opening \"%s\" for write",tmp_filename);
+		perror(str);
+		exit(1);
+	}
+	
+	fwrite(&header,sizeof(header),1,myFile);
+	
+	dag_file_node *records = (dag_file_node *)malloc(sizeof(dag_file_node)*(mydag->num_nodes ? mydag->num_nodes : 1));
+	for (int i=0;i<mydag->num_nodes;i++) {
+		node *mynode = &mydag->nodes[i];
+		dag_file_node *record = &records[i];
+	
+		record->id = mynode->id;
+		record->type = mynode->type;
+		record->asap_cycle = mynode->asap_cycle;
+		record->alap_cycle = mynode->alap_cycle;
+		record->scheduled_cycle = mynode->scheduled_cycle;
+		record->layer = mynode->layer;
+		record->input_number = mynode->input_number;
+		record->neuron = mynode->neuron;
+		record->final_adder = mynode->final_adder;
+		record->delta_multiplier = mynode->delta_multiplier;
+		record->chained = mynode->chained;
+		record->next = mynode->next ? mynode->next->index : DAG_FILE_NONE;
+		record->prev = mynode->prev ? mynode->prev->index : DAG_FILE_NONE;
+	}
+	write_section(myFile,&header,SECTION_NODES,records,sizeof(dag_file_node)*mydag->num_nodes);
+	free(records);
+	
+	int n = mydag->num_nodes;
+	int e = mydag->num_edges;
+	write_section(myFile,&header,SECTION_EDGE_PRED,mydag->edge_pred,sizeof(node_idx)*e);
+	write_section(myFile,&header,SECTION_EDGE_SUCC,mydag->edge_succ,sizeof(node_idx)*e);
+	write_section(myFile,&header,SECTION_EDGE_INPUT_NUM,mydag->edge_input_num,sizeof(int)*e);
+	write_section(myFile,&header,SECTION_IN_OFFSET,mydag->in_offset,sizeof(node_idx)*(n+1));
+	write_section(myFile,&header,SECTION_IN_EDGE_LIST,mydag->in_edge_list,sizeof(edge)*e);
+	write_section(myFile,&header,SECTION_OUT_OFFSET,mydag->out_offset,sizeof(node_idx)*(n+1));
+	write_section(myFile,&header,SECTION_OUT_EDGE_LIST,mydag->out_edge_list,sizeof(edge)*e);
+	write_section(myFile,&header,SECTION_TOPO_ORDER,order,sizeof(node_idx)*n);
+	write_section(myFile,&header,SECTION_LEVEL_OFFSET,mydag->level_offset,sizeof(node_idx)*(mydag->num_levels+1));
+	write_section(myFile,&header,SECTION_NODE_LEVEL,mydag->node_level,sizeof(int)*n);
+	write_section(myFile,&header,SECTION_LAYER_SIZE,mydag->layer_size,sizeof(int)*mydag->num_layers);
+	
+	// layer vectors are stored back to back
+	write_section(myFile,&header,SECTION_LAYER_NODES,mydag->layer_nodes[0],sizeof(node_idx)*mydag->layer_size[0]);
+	for (int l=1;l<mydag->num_layers;l++)
+		fwrite(mydag->layer_nodes[l],sizeof(node_idx),mydag->layer_size[l],myFile);
+	
+	// the list heads passed around as layers[] (one per layer, plus the final node)
+	node_idx *heads = (node_idx *)malloc(sizeof(node_idx)*(num_layers+1));
+	for (int l=0;l<=num_layers;l++) heads[l] = layers[l] ? layers[l]->index : DAG_FILE_NONE;
+	write_section(myFile,&header,SECTION_LAYERS,heads,sizeof(node_idx)*(num_layers+1));
+	free(heads);
+	
+	header.file_size = ftell(myFile);
+	fseek(myFile,0,SEEK_SET);
+	fwrite(&header,sizeof(header),1,myFile);
+	
+	if (fclose(myFile)) {
+		perror("Fatal: writing DAG cache");
+		exit(1);
+	}
+	
+	if (rename(tmp_filename,filename)) {
+		snprintf(str,1024,"ERROR: renaming \"%s\" to \"%s\"",tmp_filename,filename);
+		perror(str);
+		exit(1);
+	}
+}
+
+node **load_dag (const char *filename,int num_layers,int *layer_sizes,int inc_bias,int inc_delta_multiplier) {
+	int fd = open(filename,O_RDONLY);
+	if (fd == -1) return NULL;
+	
+	struct stat st;
+	if (fstat(fd,&st) || st.st_size < (off_t)sizeof(dag_file_header)) {
+		close(fd);
+		return NULL;
+	}
+	
+	char *mapping = (char *)mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+	close(fd);
+	if (mapping == MAP_FAILED) return NULL;
+	
+	// a stale or foreign file is ignored, and the caller rebuilds the DAG
+	dag_file_header *header = (dag_file_header *)mapping;
+	if (memcmp(header->magic,DAG_FILE_MAGIC,8) ||
+		header->version != DAG_FILE_VERSION ||
+		header->byte_order != 0x01020304 ||
+		header->node_record_size != sizeof(dag_file_node) ||
+		header->edge_record_size != sizeof(edge) ||
+		header->file_size != (uint64_t)st.st_size ||
+		header->num_layers != num_layers+1 ||
+		header->topology_hash != topology_hash(num_layers,layer_sizes,inc_bias,inc_delta_multiplier)) {
+		munmap(mapping,st.st_size);
+		return NULL;
+	}
+	
+	int n = header->num_nodes;
+	dag *mydag = (dag *)malloc(sizeof(dag));
+	memset(mydag,0,sizeof(dag));
+	
+	// nodes are the only section that is copied
+	mydag->nodes = (node *)malloc(sizeof(node)*(n ? n : 1));
+	mydag->num_nodes = mydag->max_nodes = n;
+	if (!mydag->nodes) {
+		perror("Fatal: allocating DAG arena");
+		exit(1);
+	}
+	
+	dag_file_node *records = (dag_file_node *)(mapping + header->section_offset[SECTION_NODES]);
+	for (int i=0;i<n;i++) {
+		node *mynode = &mydag->nodes[i];
+		dag_file_node *record = &records[i];
+	
+		mynode->id = record->id;
+		mynode->index = i;
+		mynode->graph = mydag;
+		mynode->type = (node_type)record->type;
+		mynode->asap_cycle = record->asap_cycle;
+		mynode->alap_cycle = record->alap_cycle;
+		mynode->scheduled_cycle = record->scheduled_cycle;
+		mynode->next = record->next == DAG_FILE_NONE ? NULL : &mydag->nodes[record->next];
+		mynode->prev = record->prev == DAG_FILE_NONE ? NULL : &mydag->nodes[record->prev];
+		mynode->visit_epoch = 0;
+		mynode->layer = record->layer;
+		mynode->input_number = record->input_number;
+		mynode->neuron = record->neuron;
+		mynode->final_adder = record->final_adder;
+		mynode->delta_multiplier = record->delta_multiplier;
+		mynode->chained = record->chained;
+		
+		index_node_id(mydag,mynode);
+	}
+	
+	// everything else is used in place
+	mydag->edge_pred = (node_idx *)(mapping + header->section_offset[SECTION_EDGE_PRED]);
+	mydag->edge_succ = (node_idx *)(mapping + header->section_offset[SECTION_EDGE_SUCC]);
+	mydag->edge_input_num = (int *)(mapping + header->section_offset[SECTION_EDGE_INPUT_NUM]);
+	mydag->num_edges = mydag->max_edges = header->num_edges;
+	
+	mydag->csr_valid = 1;
+	mydag->in_offset = (node_idx *)(mapping + header->section_offset[SECTION_IN_OFFSET]);
+	mydag->in_edge_list = (edge *)(mapping + header->section_offset[SECTION_IN_EDGE_LIST]);
+	mydag->out_offset = (node_idx *)(mapping + header->section_offset[SECTION_OUT_OFFSET]);
+	mydag->out_edge_list = (edge *)(mapping + header->section_offset[SECTION_OUT_EDGE_LIST]);
+	
+	mydag->epoch = 1;
+	
+	mydag->topo_valid = 1;
+	mydag->topo_order = (node_idx *)(mapping + header->section_offset[SECTION_TOPO_ORDER]);
+	mydag->num_levels = header->num_levels;
+	mydag->level_offset = (node_idx *)(mapping + header->section_offset[SECTION_LEVEL_OFFSET]);
+	mydag->node_level = (int *)(mapping + header->section_offset[SECTION_NODE_LEVEL]);
+	
+	mydag->num_layers = header->num_layers;
+	mydag->layer_size = (int *)(mapping + header->section_offset[SECTION_LAYER_SIZE]);
+	mydag->layer_nodes = (node_idx **)malloc(sizeof(node_idx *)*mydag->num_layers);
+	node_idx *layer_vector = (node_idx *)(mapping + header->section_offset[SECTION_LAYER_NODES]);
+	for (int l=0;l<mydag->num_layers;l++) {
+		mydag->layer_nodes[l] = layer_vector;
+		layer_vector += mydag->layer_size[l];
+	}
+	
+	mydag->mapping = mapping;
+	mydag->mapping_size = st.st_size;
+	
+	// the stored windows are only reused under the same latency model
+	mydag->timed = header->timed && header->timing_hash == timing_hash();
+	if (!mydag->timed) {
+		for (int i=0;i<n;i++) {
+			mydag->nodes[i].asap_cycle = -1;
+			mydag->nodes[i].alap_cycle = -1;
+			mydag->nodes[i].scheduled_cycle = -1;
+			mydag->nodes[i].chained = 0;
+		}
+	}
+	
+	node_idx *heads = (node_idx *)(mapping + header->section_offset[SECTION_LAYERS]);
+	node **layers = (node **)malloc((num_layers+1)*sizeof(node*));
+	for (int l=0;l<=num_layers;l++) layers[l] = heads[l] == DAG_FILE_NONE ? NULL : &mydag->nodes[heads[l]];
+	
+	return layers;
+}
+
+// copy the sections that are used in place into the heap, so the DAG can be
+// modified (and its arrays reallocated) like one built in memory
+void detach_dag (dag *mydag) {
+	if (!mydag->mapping) return;
+	
+	int n = mydag->num_nodes;
+	int e = mydag->num_edges;
+	
+#define DETACH(field,type,count)	{\
+										type *copy = (type *)malloc(sizeof(type)*((count) ? (count) : 1));\
+										memcpy(copy,mydag->field,sizeof(type)*(count));\
+										mydag->field = copy;\
+									}
+	DETACH(edge_pred,node_idx,e);
+	DETACH(edge_succ,node_idx,e);
+	DETACH(edge_input_num,int,e);
+	DETACH(in_offset,node_idx,n+1);
+	DETACH(in_edge_list,edge,e);
+	DETACH(out_offset,node_idx,n+1);
+	DETACH(out_edge_list,edge,e);
+	DETACH(topo_order,node_idx,n);
+	DETACH(level_offset,node_idx,mydag->num_levels+1);
+	DETACH(node_level,int,n);
+	for (int l=0;l<mydag->num_layers;l++) DETACH(layer_nodes[l],node_idx,mydag->layer_size[l]);
+	DETACH(layer_size,int,mydag->num_layers);
+#undef DETACH
+	
+	munmap(mydag->mapping,mydag->mapping_size);
+	mydag->mapping = NULL;
+	mydag->mapping_size = 0;
+}
+
+node **load_network_dag (const char *filename,int num_layers,int *layer_sizes,int inc_bias,int inc_delta_multiplier) {
+	node **layers = load_dag(filename,num_layers,layer_sizes,inc_bias,inc_delta_multiplier);
+	
+	if (layers) {
+		logmsg("Loaded DAG from \"%s\"%s",filename,layers[0]->graph->timed ? " (with schedule)" : "");
+		return layers;
+	}
+	
+	return create_basic_network_dag(num_layers,layer_sizes,inc_bias,inc_delta_multiplier);
+}
@@ -1,163 +1,285 @@
 #include "netscheduler.h"
 
-void connect_nodes (node *pred,node *succ,int input_num) {
-	edge *myedge;
-
-	// add incoming edge
-	if (succ->in_edges == NULL) {
-		myedge = succ->in_edges = (edge *)malloc(sizeof(edge));
-		myedge->edge = pred;
-		myedge->next = NULL;
-	} else {
-		myedge = succ->in_edges;
-		while (myedge->next) myedge = myedge->next;
-		myedge = myedge->next = (edge *)malloc(sizeof(edge));
-		myedge->edge = pred;
-		myedge->next = NULL;
+dag *create_dag (int max_nodes,int max_edges) {
+	dag *mydag = (dag *)malloc(sizeof(dag));
+	
+	// the node arena is never reallocated, since the layer lists and
+	// the traversal routines hold pointers into it
+	mydag->nodes = (node *)malloc(sizeof(node)*max_nodes);
+	mydag->num_nodes = 0;
+	mydag->max_nodes = max_nodes;
+	
+	// the edge list can grow, since edges are only referred to by index
+	if (max_edges < 1) max_edges = 1;
+	mydag->edge_pred = (node_idx *)malloc(sizeof(node_idx)*max_edges);
+	mydag->edge_succ = (node_idx *)malloc(sizeof(node_idx)*max_edges);
+	mydag->edge_input_num = (int *)malloc(sizeof(int)*max_edges);
+	mydag->num_edges = 0;
+	mydag->max_edges = max_edges;
+	
+	mydag->csr_valid = 0;
+	mydag->epoch = 1;
+	mydag->topo_valid = 0;
+	mydag->topo_order = NULL;
+	mydag->num_levels = 0;
+	mydag->level_offset = NULL;
+	mydag->node_level = NULL;
+	mydag->in_offset = NULL;
+	mydag->in_edge_list = NULL;
+	mydag->out_offset = NULL;
+	mydag->out_edge_list = NULL;
+	mydag->num_layers = 0;
+	mydag->layer_size = NULL;
+	mydag->layer_nodes = NULL;
+	mydag->id_index = NULL;
+	mydag->id_index_size = 0;
+	mydag->timed = 0;
+	mydag->mapping = NULL;
+	mydag->mapping_size = 0;
+	
+	if (!mydag->nodes || !mydag->edge_pred || !mydag->edge_succ || !mydag->edge_input_num) {
+		perror("Fatal: allocating DAG arena");
+		exit(1);
 	}
-	myedge->input_num = input_num;
+	
+	return mydag;
+}
 
-	// add outgoing edge
-	myedge = pred->out_edges;
-	if (myedge == NULL) {
-		myedge = pred->out_edges = (edge *)malloc(sizeof(edge));
-		myedge->edge = succ;
-		myedge->next = NULL;
-	} else {
-		myedge = pred->out_edges;
-		while (myedge->next) myedge = myedge->next;
-		myedge = myedge->next = (edge *)malloc(sizeof(edge));
-		myedge->edge = succ;
-		myedge->next = NULL;
+void free_dag (dag *mydag) {
+	detach_dag(mydag);
+	
+	for (int i=0;i<mydag->num_layers;i++) free(mydag->layer_nodes[i]);
+	free(mydag->layer_nodes);
+	free(mydag->layer_size);
+	free(mydag->id_index);
+	free(mydag->topo_order);
+	free(mydag->level_offset);
+	free(mydag->node_level);
+	free(mydag->in_offset);
+	free(mydag->in_edge_list);
+	free(mydag->out_offset);
+	free(mydag->out_edge_list);
+	free(mydag->edge_pred);
+	free(mydag->edge_succ);
+	free(mydag->edge_input_num);
+	free(mydag->nodes);
+	free(mydag);
+}
+
+void build_csr (dag *mydag) {
+	int n = mydag->num_nodes;
+	int e = mydag->num_edges;
+	
+	mydag->in_offset = (node_idx *)realloc(mydag->in_offset,sizeof(node_idx)*(n+1));
+	mydag->out_offset = (node_idx *)realloc(mydag->out_offset,sizeof(node_idx)*(n+1));
+	mydag->in_edge_list = (edge *)realloc(mydag->in_edge_list,sizeof(edge)*(e ? e : 1));
+	mydag->out_edge_list = (edge *)realloc(mydag->out_edge_list,sizeof(edge)*(e ? e : 1));
+	
+	// count degrees
+	for (int i=0;i<=n;i++) {
+		mydag->in_offset[i]=0;
+		mydag->out_offset[i]=0;
 	}
-	myedge->input_num = input_num;
+	for (int i=0;i<e;i++) {
+		mydag->in_offset[mydag->edge_succ[i]+1]++;
+		mydag->out_offset[mydag->edge_pred[i]+1]++;
+	}
+	
+	// prefix sum into row offsets
+	for (int i=0;i<n;i++) {
+		mydag->in_offset[i+1] += mydag->in_offset[i];
+		mydag->out_offset[i+1] += mydag->out_offset[i];
+	}
+	
+	// scatter edges, keeping insertion order within each row
+	node_idx *in_fill = (node_idx *)malloc(sizeof(node_idx)*(n ? n : 1));
+	node_idx *out_fill = (node_idx *)malloc(sizeof(node_idx)*(n ? n : 1));
+	memcpy(in_fill,mydag->in_offset,sizeof(node_idx)*n);
+	memcpy(out_fill,mydag->out_offset,sizeof(node_idx)*n);
+	
+	for (int i=0;i<e;i++) {
+		edge *myedge = &mydag->in_edge_list[in_fill[mydag->edge_succ[i]]++];
+		myedge->node_index = mydag->edge_pred[i];
+		myedge->input_num = mydag->edge_input_num[i];
+		
+		myedge = &mydag->out_edge_list[out_fill[mydag->edge_pred[i]]++];
+		myedge->node_index = mydag->edge_succ[i];
+		myedge->input_num = mydag->edge_input_num[i];
+	}
+	
+	free(in_fill);
+	free(out_fill);
+	
+	mydag->csr_valid = 1;
+}
 
+void connect_nodes (node *pred,node *succ,int input_num) {
+	dag *mydag = pred->graph;
+	detach_dag(mydag);
+	
+	// grow the edge list if needed
+	if (mydag->num_edges == mydag->max_edges) {
+		mydag->max_edges *= 2;
+		mydag->edge_pred = (node_idx *)realloc(mydag->edge_pred,sizeof(node_idx)*mydag->max_edges);
+		mydag->edge_succ = (node_idx *)realloc(mydag->edge_succ,sizeof(node_idx)*mydag->max_edges);
+		mydag->edge_input_num = (int *)realloc(mydag->edge_input_num,sizeof(int)*mydag->max_edges);
+		if (!mydag->edge_pred || !mydag->edge_succ || !mydag->edge_input_num) {
+			perror("Fatal: growing DAG edge list");
+			exit(1);
+		}
+	}
+	
+	// append edge; the CSR rows are rebuilt on the next traversal
+	mydag->edge_pred[mydag->num_edges] = pred->index;
+	mydag->edge_succ[mydag->num_edges] = succ->index;
+	mydag->edge_input_num[mydag->num_edges] = input_num;
+	mydag->num_edges++;
+	mydag->csr_valid = 0;
+	mydag->topo_valid = 0;
 }
 
-node *create_node (node_type type,int id) {
-	node *mynode = (node *)malloc(sizeof(node));
+node *create_node (dag *mydag,node_type type,int id) {
+	detach_dag(mydag);
+	
+	if (mydag->num_nodes == mydag->max_nodes) {
+		fprintf(stderr,"Fatal: DAG node arena exhausted (%d nodes).\n",mydag->max_nodes);
+		exit(1);
+	}
+	
+	node *mynode = &mydag->nodes[mydag->num_nodes];
+	mynode->index = mydag->num_nodes++;
+	mynode->graph = mydag;
 	mynode->type = type;
 	mynode->id = id;
-	mynode->in_edges = NULL; // no inputs yet
-	mynode->out_edges = NULL; // no outputs yet
 	mynode->next = NULL;
 	mynode->prev = NULL;
 	mynode->asap_cycle = -1;
 	mynode->alap_cycle = -1;
 	mynode->scheduled_cycle = -1;
+	mynode->visit_epoch = 0;
+	mynode->layer = 0;
+	mynode->input_number = 0;
+	mynode->neuron = 0;
 	mynode->final_adder = 0;
 	mynode->delta_multiplier = 0;
+	mynode->chained = 0;
+	mydag->csr_valid = 0;
+	mydag->topo_valid = 0;
+	
+	index_node_id(mydag,mynode);
 	
 	return mynode;
 }
 
-void traverse_dag (node *layers[],
-				   int num_layers,
-				   int num_inputs,
-				   int num_outputs,
-				   void *args,
-				   void (nodefunc)(node *,void *),
-				   travordertype travorder) {
-					   
-	int head=0,tail=0,nodes_in_start_layer;
-	node **stack,*mynode;
-	edge *myedge;
+void index_node_id (dag *mydag,node *mynode) {
+	int id = mynode->id;
 	
-	stack = (node **)malloc(QUEUESIZE*sizeof(node *));
+	// template ports and other helper nodes may have no valid id
+	if (id < 0) return;
 	
-	// prepare to add first level
-	if (travorder==FROM_START) {
-		nodes_in_start_layer = num_inputs;
-		mynode = layers[0];
-	} else {
-		nodes_in_start_layer = num_outputs;
-		mynode = layers[num_layers];
+	if (id >= mydag->id_index_size) {
+		int size = mydag->id_index_size ? mydag->id_index_size : 1024;
+		while (size <= id) size *= 2;
+		
+		mydag->id_index = (node_idx *)realloc(mydag->id_index,sizeof(node_idx)*size);
+		if (!mydag->id_index) {
+			perror("Fatal: growing DAG id index");
+			exit(1);
+		}
+		for (int i=mydag->id_index_size;i<size;i++) mydag->id_index[i] = NO_NODE;
+		mydag->id_index_size = size;
 	}
 	
-	// add first level
-	while (mynode) {
-		// push start node
-		stack[tail]=mynode;
-		tail = (tail + 1) % QUEUESIZE;
-		mynode=mynode->next;
-	}
+	mydag->id_index[id] = mynode->index;
+}
+
+node *node_by_id (dag *mydag,int id) {
+	if (id < 0 || id >= mydag->id_index_size || mydag->id_index[id] == NO_NODE) return NULL;
 	
-	// breadth-first traversal from each input or output (depending on direction)
-	while (head!=tail) {
-		// pop node
-		node *mynode = stack[head];
-		head = (head + 1) % QUEUESIZE;
+	return &mydag->nodes[mydag->id_index[id]];
+}
 
-		// push successors/predecessors
-		if (travorder==FROM_START) {
-			myedge = mynode->out_edges;
-		} else {
-			myedge = mynode->in_edges;
-		}
+// set the scheduled cycle of every node in a solution, given as parallel
+// arrays of node ids and cycles
+void apply_solution (dag *mydag,const int *ids,const int *cycles,int count) {
+	for (int i=0;i<count;i++) {
+		node *mynode = node_by_id(mydag,ids[i]);
 		
-		while (myedge) {
-			if ((tail+1) % QUEUESIZE == head) {
-				fprintf(stderr,"Fatal: traversal queue size exceeded (currently at %d).\n",tail-head < 0 ? head-tail : tail-head);
-				exit(1);
-			}
-			stack[tail] = myedge->edge;
-			tail=(tail + 1) % QUEUESIZE;
-			myedge = myedge->next;
+		if (!mynode) {
+			fprintf(stderr,"Fatal: solution refers to unknown node id %d.\n",ids[i]);
+			exit(1);
 		}
 		
-		// process node
-		nodefunc(mynode,args);
+		mynode->scheduled_cycle = cycles[i];
 	}
-
-	free(stack);
 }
 
-void node2dot (node *mynode,void *args) {
-	argstype *myargs = (argstype *)args;
-	FILE *myFile = myargs->file;
-	char node_shape[1024];
+node_idx *topological_order (dag *mydag) {
+	if (mydag->topo_valid) return mydag->topo_order;
 	
-	if (!mynode->flag) {
-		
-		switch (mynode->type) {
-			case INPUT: strcpy(node_shape,"cds");break;
-			case OUTPUT: strcpy(node_shape,"cds");break;
-			case MULT: strcpy(node_shape,"box");break;
-			case ADD: strcpy(node_shape,"ellipse");break;
-			case ADDBIAS: strcpy(node_shape,"square");break;
-			default: strcpy(node_shape,"star");break;
-		}
+	// make sure the adjacency rows reflect the latest edges
+	if (!mydag->csr_valid) build_csr(mydag);
+	
+	int n = mydag->num_nodes;
+	int head=0,tail=0;
+	node_idx *order = mydag->topo_order = (node_idx *)realloc(mydag->topo_order,sizeof(node_idx)*(n ? n : 1));
+	int *pending = (int *)malloc(sizeof(int)*(n ? n : 1));
+	node_idx *level_offset = mydag->level_offset = (node_idx *)realloc(mydag->level_offset,sizeof(node_idx)*(n+1));
+	int num_levels=0;
+	
+	// Kahn's algorithm, using the order array itself as the queue
+	for (int i=0;i<n;i++) {
+		pending[i] = NUM_IN_EDGES(&mydag->nodes[i]);
+		if (!pending[i]) order[tail++] = i;
+	}
+	
+	while (head!=tail) {
+		// the queue is FIFO, so everything enqueued while draining one
+		// level belongs to the next level
+		if (!num_levels || head==(int)level_offset[num_levels]) level_offset[++num_levels] = tail;
 		
-		// print node
-		fprintf (myFile,"%s_%d [shape=%s fontsize=10 label=\"%s_%d(%d,%d,%d)\"]\n",NODETYPE(mynode->type),
-																				 mynode->id,
-																				 node_shape,
-																				 NODETYPE(mynode->type),
-																				 mynode->id,
-																				 mynode->asap_cycle,
-																				 mynode->alap_cycle,
-																				 mynode->scheduled_cycle);
+		node *mynode = &mydag->nodes[order[head++]];
 		
-		// push successors onto stack
-		char rank_stmt[1024],node_name[1024];
-		snprintf(rank_stmt,1024,"{rank=same; ");
-
-		edge *myedge = mynode->in_edges;
-		while (myedge) {
-			fprintf (myFile,"%s_%d -> %s_%d\n",NODETYPE(myedge->edge->type),
-											   myedge->edge->id,
-											   NODETYPE(mynode->type),
-											   mynode->id);
-
-			snprintf (node_name,1024,"%s_%d; ",NODETYPE(myedge->edge->type),myedge->edge->id);
-			strcat(rank_stmt,node_name);
-
-			myedge = myedge->next;
+		for (int i=0;i<NUM_OUT_EDGES(mynode);i++) {
+			node_idx succ = OUT_EDGE(mynode,i).node_index;
+			if (--pending[succ]==0) order[tail++] = succ;
 		}
-		strcat (rank_stmt,"}\n");
-		fprintf(myFile,"%s",rank_stmt);
-		
-		mynode->flag=1;
+	}
+	
+	free(pending);
+	level_offset[0] = 0;
+	mydag->num_levels = num_levels;
+	
+	mydag->node_level = (int *)realloc(mydag->node_level,sizeof(int)*(n ? n : 1));
+	for (int l=0;l<num_levels;l++)
+		for (node_idx i=level_offset[l];i<level_offset[l+1];i++) mydag->node_level[order[i]] = l;
+	
+	if (tail != n) {
+		fprintf(stderr,"Fatal: DAG contains a cycle (%d of %d nodes ordered).\n",tail,n);
+		exit(1);
+	}
+	
+	mydag->topo_valid = 1;
+	return order;
+}
+
+void traverse_dag (node *layers[],
+				   int num_layers,
+				   int num_inputs,
+				   int num_outputs,
+				   void *args,
+				   void (nodefunc)(node *,void *),
+				   travordertype travorder) {
+					   
+	dag *mydag = layers[0]->graph;
+	node_idx *order = topological_order(mydag);
+	
+	// visit each node exactly once, after all of its predecessors (FROM_START)
+	// or after all of its successors (FROM_END)
+	if (travorder==FROM_START) {
+		for (int i=0;i<mydag->num_nodes;i++) nodefunc(&mydag->nodes[order[i]],args);
+	} else {
+		for (int i=mydag->num_nodes-1;i>=0;i--) nodefunc(&mydag->nodes[order[i]],args);
 	}
 }
 
@@ -179,20 +301,20 @@ void gen_dot (node *layers[],
 		perror("popen()");
 		exit(1);
 	}
-
-	fprintf(myFile,"digraph {\nrankdir=LR;\n");
-
-	argstype myargs = {.file = myFile};
 	
-	traverse_dag(layers,num_layers,num_inputs,num_outputs,(void *)&myargs,clear_flags,FROM_END);
-	traverse_dag(layers,num_layers,num_inputs,num_outputs,(void *)&myargs,node2dot,FROM_END);
+	char *buffer = (char *)malloc(GRAPH_WRITE_BUFFER);
+	setvbuf(myFile,buffer,_IOFBF,GRAPH_WRITE_BUFFER);
 
-	fprintf(myFile,"}\n");
-	fclose(myFile);
+	// large DAGs are drawn with one summary node per neuron, since dot
+	// can't lay out the full graph
+	export_graph(layers,myFile,GRAPH_DOT,layers[0]->graph->num_nodes > GRAPH_CLUSTER_THRESHOLD);
+
+	pclose(myFile);
+	free(buffer);
 }
 
 int node_is_final_adder (node *mynode) {
-	if (mynode->type == ADD && mynode->out_edges->edge->type == MULT) return 1;
+	if (mynode->type == ADD && OUT_NODE(mynode,0)->type == MULT) return 1;
 	return 0;
 }
 
@@ -202,24 +324,21 @@ void gen_c_declarations (node *mynode,void *args) {
 	int gen_backwards = ((argstype *)args)->gen_backwards;
 	int secondforward = ((argstype *)args)->secondforward;
 	
-	if (!mynode->flag) {
-		if	((mynode->type==ADD || mynode->type==MULT || mynode->type==ADDBIAS) || (gen_backwards && mynode->type==INPUT)) {
-			// the current output of the DAG node (input, adder, etc.)
-			if (gen_backwards==0 && secondforward==0)
-				fprintf (myFile,"node%d,",mynode->id);
-			else if (secondforward)
-				fprintf (myFile,"node_sf%d,",mynode->id);
-			else if (gen_backwards)
-				fprintf (myFile,"node_bp%d,",mynode->id);
-			
-			/* // the historical outputs of each node, needed only for the outputs of neurons
-			if (node_is_final_adder(mynode)) {
-				for (int i=0;i<shift_reg_depth;i++) {
-					fprintf (myFile,"node%d_d%d,",mynode->id,i);
-				}
-			} */
-		}
-		mynode->flag=1;
+	if	((mynode->type==ADD || mynode->type==MULT || mynode->type==ADDBIAS) || (gen_backwards && mynode->type==INPUT)) {
+		// the current output of the DAG node (input, adder, etc.)
+		if (gen_backwards==0 && secondforward==0)
+			fprintf (myFile,"node%d,",mynode->id);
+		else if (secondforward)
+			fprintf (myFile,"node_sf%d,",mynode->id);
+		else if (gen_backwards)
+			fprintf (myFile,"node_bp%d,",mynode->id);
+		
+		/* // the historical outputs of each node, needed only for the outputs of neurons
+		if (node_is_final_adder(mynode)) {
+			for (int i=0;i<shift_reg_depth;i++) {
+				fprintf (myFile,"node%d_d%d,",mynode->id,i);
+			}
+		} */
 	}
 }
 
@@ -229,17 +348,12 @@ node *get_correspondance_node (node *mynode,node **forwardprop) {
 	int forwardlayer = NUM_LAYERS - backlayer - 1;
 	int neuron = mynode->neuron;
 	
-	// walk across layer
-	node *forward_node = forwardprop[forwardlayer];
-	for (int i=0;i<neuron;i++) {
-		forward_node = forward_node->next;
-	}
-	return forward_node;
+	return LAYER_NODE(forwardprop[0]->graph,forwardlayer,neuron);
 }
 
 void gen_c_statement (node *mynode,void *args) {
 	char suffix[1024];
-	edge *myedge = mynode->in_edges;
+	int num_in_edges = NUM_IN_EDGES(mynode);
 	FILE *myFile = ((argstype *)args)->file;
 	int shift_reg_depth = ((argstype *)args)->shift_reg_depth;
 	int backprop = ((argstype *)args)->backprop;
@@ -249,174 +363,165 @@ void gen_c_statement (node *mynode,void *args) {
 	int layer = mynode->layer;
 	int secondforward = ((argstype *)args)->secondforward;
 
-	// only generate statements for add and multiply
-	if (!mynode->flag) {
+	// nodes are visited in topological order, so the statements of all
+	// predecessors have already been generated
 
-		// check if all predecessors have been generated
-		int deps_satisfied=1;
-		edge *pred = mynode->in_edges;
-		while (pred) {
-			if (!pred->edge->flag) deps_satisfied=0;
-			pred=pred->next;
-		}
-	
-		// make sure dependencies are satisfied before generating code for this node
-		if (deps_satisfied) {
+	// establish a suffix for backprop nodes
+	if (secondforward)
+		strcpy(suffix,"_sf");
+	else if (backprop)
+		strcpy(suffix,"_bp");
+	else
+		strcpy(suffix,"");
 
-			// establish a suffix for backprop nodes
+	// CASE 1:  forward prop output node
+	if (mynode->type == OUTPUT && !backprop && !secondforward) {
+		if (secondforward) return;
+		fprintf(myFile,"\toutput%s%d = node%s%d;\n",suffix,mynode->id,suffix,IN_NODE(mynode,0)->id);
+	
+	// CASE 2:  backward prop delta multiplier node
+	} else if (mynode->delta_multiplier) {
+		node *fpn = get_correspondance_node(mynode,forwardprop);
+		//node *fpn = forwardprop[NUM_LAYERS-layer];
+		
+		if (fpn->type==INPUT)
+			fprintf(myFile,"\tnode_bp%d = node_bp%d * node%d_d%d;\n",
+						mynode->id,
+						IN_NODE(mynode,0)->id,
+						fpn->id,
+						shift_reg_depth);
+		else
+			fprintf(myFile,"\tnode_bp%d = node_bp%d * node_sf%d;\n",
+						mynode->id,
+						IN_NODE(mynode,0)->id,
+						fpn->id);
+	
+	// CASE 3:  backprop input node (which represents an output node in the forward prop)
+	} else if (mynode->type == INPUT && backprop) {
+		// SHOULD BE OUTPUT OF SECOND FORWARD PASS!
+		fprintf (myFile,"\tnode_bp%d = (node_sf%d - input%d);\n",
+					mynode->id,
+					get_correspondance_node(mynode,forwardprop)->id,
+					HISTORY_LENGTH-1);
+		
+		// update biases
+		fprintf (myFile,"\tbias_fp%d[%d] -= LEARN_RATE * node_bp%d;\n",NUM_LAYERS-1,mynode->neuron,mynode->id);
+		fprintf (myFile,"\tbias_bp%d[%d] -= LEARN_RATE * node_bp%d;\n",NUM_LAYERS-1,mynode->neuron,mynode->id);
+		
+		// update weights of output node coefficients
+		node *mynode_forward = get_correspondance_node(mynode,forwardprop);
+		
+	// CASE 4:  all other nodes, assuming incoming edges
+	} else if (num_in_edges && !(mynode->type==OUTPUT && secondforward)) {
+		node *pred = IN_NODE(mynode,0);
+		
+		// ** begin the statement
+		if (pred->type == INPUT) {
 			if (secondforward)
-				strcpy(suffix,"_sf");
+				fprintf(myFile,"\tnode%s%d = node%d_d%d ",
+					suffix,mynode->id,pred->id,FORECAST_LENGTH);
 			else if (backprop)
-				strcpy(suffix,"_bp");
+				fprintf (myFile,"\tnode%s%d = node_bp%d ",suffix,mynode->id,pred->id);
 			else
-				strcpy(suffix,"");
-
-			// CASE 1:  forward prop output node
-			if (mynode->type == OUTPUT && !backprop && !secondforward) {
-				if (secondforward) return;
-				fprintf(myFile,"\toutput%s%d = node%s%d;\n",suffix,mynode->id,suffix,myedge->edge->id);
-			
-			// CASE 2:  backward prop delta multiplier node
-			} else if (mynode->delta_multiplier) {
-				node *fpn = get_correspondance_node(mynode,forwardprop);
-				//node *fpn = forwardprop[NUM_LAYERS-layer];
-				
-				if (fpn->type==INPUT)
-					fprintf(myFile,"\tnode_bp%d = node_bp%d * node%d_d%d;\n",
-								mynode->id,
-								mynode->in_edges->edge->id,
-								fpn->id,
-								shift_reg_depth);
-				else
-					fprintf(myFile,"\tnode_bp%d = node_bp%d * node_sf%d;\n",
-								mynode->id,
-								mynode->in_edges->edge->id,
-								fpn->id);
-			
-			// CASE 3:  backprop input node (which represents an output node in the forward prop)
-			} else if (mynode->type == INPUT && backprop) {
-				// SHOULD BE OUTPUT OF SECOND FORWARD PASS!
-				fprintf (myFile,"\tnode_bp%d = (node_sf%d - input%d);\n",
-							mynode->id,
-							get_correspondance_node(mynode,forwardprop)->id,
-							HISTORY_LENGTH-1);
-				
-				// update biases
-				fprintf (myFile,"\tbias_fp%d[%d] -= LEARN_RATE * node_bp%d;\n",NUM_LAYERS-1,mynode->neuron,mynode->id);
-				fprintf (myFile,"\tbias_bp%d[%d] -= LEARN_RATE * node_bp%d;\n",NUM_LAYERS-1,mynode->neuron,mynode->id);
-				
-				// update weights of output node coefficients
-				node *mynode_forward = get_correspondance_node(mynode,forwardprop);
-				
-			// CASE 4:  all other nodes, assuming incoming edges
-			} else if (myedge && !(mynode->type==OUTPUT && secondforward)) {
-				// ** begin the statement
-				if (myedge->edge->type == INPUT) {
-					if (secondforward)
-						fprintf(myFile,"\tnode%s%d = node%d_d%d ",
-							suffix,mynode->id,myedge->edge->id,FORECAST_LENGTH);
-					else if (backprop)
-						fprintf (myFile,"\tnode%s%d = node_bp%d ",suffix,mynode->id,myedge->edge->id);
-					else
-						fprintf(myFile,"\tnode%s%d = input%d ",suffix,mynode->id,myedge->edge->id);
-				} else {
-					if (!backprop || mynode->type != OUTPUT) {
-						fprintf(myFile,"\tnode%s%d = node%s%d ",suffix,mynode->id,suffix,myedge->edge->id);
-					}
-				}
-				// ** finish the statement
-				myedge = myedge->next;
-				switch (mynode->type) {
-					case ADD:
-						fprintf (myFile,"+ node%s%d;\n",suffix,myedge->edge->id);
-						
-						// update bias in forward and backprop
-						if (backprop && mynode->final_adder) {
-							fprintf (myFile,"\tbias_bp%d[%d] -= LEARN_RATE * node_bp%d;\n",NUM_LAYERS-mynode->layer,mynode->neuron,mynode->id);
-							fprintf (myFile,"\tbias_fp%d[%d] -= LEARN_RATE * node_bp%d;\n",NUM_LAYERS-mynode->layer,mynode->neuron,mynode->id);
-						}
-						
-						break;
-					case MULT:
-						if (backprop)
-							fprintf (myFile,"* coeff_bp%d[%d][%d];\n",NUM_LAYERS - mynode->layer,mynode->input_number,mynode->neuron);
-						else
-							fprintf (myFile,"* coeff_fp%d[%d][%d];\n",mynode->layer,mynode->neuron,mynode->input_number);
-						
-						break;
-					case ADDBIAS:
-						if (backprop)
-							fprintf (myFile,"+ bias_bp%d[%d];\n",mynode->layer,mynode->neuron);
-						else
-							fprintf (myFile,"+ bias_fp%d[%d];\n",mynode->layer,mynode->neuron);
-						break;
-				}
+				fprintf(myFile,"\tnode%s%d = input%d ",suffix,mynode->id,pred->id);
+		} else {
+			if (!backprop || mynode->type != OUTPUT) {
+				fprintf(myFile,"\tnode%s%d = node%s%d ",suffix,mynode->id,suffix,pred->id);
 			}
-
-			// for backprop, add weight update code
-			if (backprop && mynode->final_adder && !secondforward) {
-			// find predecessor of the corresponding node in forward pass
-				
-				// for each outgoing edge (incoming edge in forward prop)
-				
-				int layer_in_forward_pass = NUM_LAYERS-(mynode->layer);
+		}
+		// ** finish the statement
+		switch (mynode->type) {
+			case ADD:
+				fprintf (myFile,"+ node%s%d;\n",suffix,IN_NODE(mynode,1)->id);
 				
-				// update biases
-				if (NUM_LAYERS-mynode->layer-1)
-					fprintf (myFile,"\tbias_fp%d[%d] -= LEARN_RATE * node_bp%d;\n"
-									"\tbias_bp%d[%d] -= LEARN_RATE * node_bp%d;\n",
-										NUM_LAYERS-mynode->layer-1,
-										mynode->neuron,
-										mynode->id,
-										NUM_LAYERS-mynode->layer-1,
-										mynode->neuron,
-										mynode->id);
+				// update bias in forward and backprop
+				if (backprop && mynode->final_adder) {
+					fprintf (myFile,"\tbias_bp%d[%d] -= LEARN_RATE * node_bp%d;\n",NUM_LAYERS-mynode->layer,mynode->neuron,mynode->id);
+					fprintf (myFile,"\tbias_fp%d[%d] -= LEARN_RATE * node_bp%d;\n",NUM_LAYERS-mynode->layer,mynode->neuron,mynode->id);
+				}
 				
-				for (node *n=forwardprop[layer_in_forward_pass];n;n=n->next) {
+				break;
+			case MULT:
+				if (backprop)
+					fprintf (myFile,"* coeff_bp%d[%d][%d];\n",NUM_LAYERS - mynode->layer,mynode->input_number,mynode->neuron);
+				else
+					fprintf (myFile,"* coeff_fp%d[%d][%d];\n",mynode->layer,mynode->neuron,mynode->input_number);
 				
-					if (get_correspondance_node(mynode,forwardprop)->type==INPUT)
-						fprintf (myFile,
-							"\tcoeff_fp%d[%d][%d] -= LEARN_RATE * node_bp%d * node%d_d%d;\n"
-							"\tcoeff_bp%d[%d][%d] -= LEARN_RATE * node_bp%d * node%d_d%d;\n",
-							NUM_LAYERS-mynode->layer, // original layer
-							n->neuron, // edge number
-							mynode->neuron, // output number
-							get_correspondance_node(n,backwardprop)->id,
-							get_correspondance_node(mynode,forwardprop)->id,
-							shift_reg_depth,
-							NUM_LAYERS-mynode->layer, // original layer
-							n->neuron, // edge number
-							mynode->neuron, // output number
-							get_correspondance_node(n,backwardprop)->id,
-							get_correspondance_node(mynode,forwardprop)->id,
-							shift_reg_depth);
-					else
-						fprintf (myFile,
-							"\tcoeff_fp%d[%d][%d] -= LEARN_RATE * node_bp%d * node_sf%d;\n"
-							"\tcoeff_bp%d[%d][%d] -= LEARN_RATE * node_bp%d * node_sf%d;\n",
-							NUM_LAYERS-mynode->layer, // original layer
-							n->neuron, // edge number
-							mynode->neuron, // output number
-							get_correspondance_node(n,backwardprop)->id,
-							get_correspondance_node(mynode,forwardprop)->id,
-							NUM_LAYERS-mynode->layer, // original layer
-							n->neuron, // edge number
-							mynode->neuron, // output number
-							get_correspondance_node(n,backwardprop)->id,
-							get_correspondance_node(mynode,forwardprop)->id);
-						
-					//e++;
-				}
-			}
+				break;
+			case ADDBIAS:
+				if (backprop)
+					fprintf (myFile,"+ bias_bp%d[%d];\n",mynode->layer,mynode->neuron);
+				else
+					fprintf (myFile,"+ bias_fp%d[%d];\n",mynode->layer,mynode->neuron);
+				break;
+		}
+	}
 
-			mynode->flag = 1;
+	// for backprop, add weight update code
+	if (backprop && mynode->final_adder && !secondforward) {
+	// find predecessor of the corresponding node in forward pass
+		
+		// for each outgoing edge (incoming edge in forward prop)
+		
+		int layer_in_forward_pass = NUM_LAYERS-(mynode->layer);
+		
+		// update biases
+		if (NUM_LAYERS-mynode->layer-1)
+			fprintf (myFile,"\tbias_fp%d[%d] -= LEARN_RATE * node_bp%d;\n"
+							"\tbias_bp%d[%d] -= LEARN_RATE * node_bp%d;\n",
+								NUM_LAYERS-mynode->layer-1,
+								mynode->neuron,
+								mynode->id,
+								NUM_LAYERS-mynode->layer-1,
+								mynode->neuron,
+								mynode->id);
+		
+		for (node *n=forwardprop[layer_in_forward_pass];n;n=n->next) {
+		
+			if (get_correspondance_node(mynode,forwardprop)->type==INPUT)
+				fprintf (myFile,
+					"\tcoeff_fp%d[%d][%d] -= LEARN_RATE * node_bp%d * node%d_d%d;\n"
+					"\tcoeff_bp%d[%d][%d] -= LEARN_RATE * node_bp%d * node%d_d%d;\n",
+					NUM_LAYERS-mynode->layer, // original layer
+					n->neuron, // edge number
+					mynode->neuron, // output number
+					get_correspondance_node(n,backwardprop)->id,
+					get_correspondance_node(mynode,forwardprop)->id,
+					shift_reg_depth,
+					NUM_LAYERS-mynode->layer, // original layer
+					n->neuron, // edge number
+					mynode->neuron, // output number
+					get_correspondance_node(n,backwardprop)->id,
+					get_correspondance_node(mynode,forwardprop)->id,
+					shift_reg_depth);
+			else
+				fprintf (myFile,
+					"\tcoeff_fp%d[%d][%d] -= LEARN_RATE * node_bp%d * node_sf%d;\n"
+					"\tcoeff_bp%d[%d][%d] -= LEARN_RATE * node_bp%d * node_sf%d;\n",
+					NUM_LAYERS-mynode->layer, // original layer
+					n->neuron, // edge number
+					mynode->neuron, // output number
+					get_correspondance_node(n,backwardprop)->id,
+					get_correspondance_node(mynode,forwardprop)->id,
+					NUM_LAYERS-mynode->layer, // original layer
+					n->neuron, // edge number
+					mynode->neuron, // output number
+					get_correspondance_node(n,backwardprop)->id,
+					get_correspondance_node(mynode,forwardprop)->id);
+				
+			//e++;
 		}
 	}
 	
 }
 
-void clear_flags (node *mynode,void *args) {
-	mynode->flag=0;
+void clear_flags (dag *mydag) {
+	// start a new visitation epoch, which unmarks every node at once
+	if (++mydag->epoch == 0) {
+		// the counter wrapped, so stale marks could match again
+		for (int i=0;i<mydag->num_nodes;i++) mydag->nodes[i].visit_epoch = 0;
+		mydag->epoch = 1;
+	}
 }
 
 void compute_functional_utilization(node **layers,int num_layers,int num_inputs,int num_outputs,argstype *myargs) {
@@ -425,26 +530,30 @@ void compute_functional_utilization(node **layers,int num_layers,int num_inputs,
 	int max_latency = layers[num_layers]->alap_cycle;
 	
 	// allocate and initialize function unit usage counters
-	myargs->add_use = (int *)malloc(sizeof(int) * max_latency);
-	for (int i=0;i<max_latency;i++) myargs->add_use[i]=0;
-	myargs->mult_use = (int *)malloc(sizeof(int) * max_latency);
-	for (int i=0;i<max_latency;i++) myargs->mult_use[i]=0;
+	myargs->add_use = (int *)malloc(sizeof(int) * (max_latency+1));
+	for (int i=0;i<=max_latency;i++) myargs->add_use[i]=0;
+	myargs->mult_use = (int *)malloc(sizeof(int) * (max_latency+1));
+	for (int i=0;i<=max_latency;i++) myargs->mult_use[i]=0;
 	
-	traverse_dag(layers,num_layers,num_inputs,num_outputs,(void *)myargs,clear_flags,FROM_START);
 	traverse_dag(layers,num_layers,num_inputs,num_outputs,(void *)myargs,inc_functional_utilization,FROM_START);
 }
 
 void inc_functional_utilization (node *mynode,void *args) {
 	argstype *myargs = (argstype *)args;
 	
-	if (!mynode->flag) {
-	
-		for (int i=mynode->asap_cycle;i<=mynode->alap_cycle;i++) {
-			if (mynode->type == ADD) myargs->add_use[i]++; else
-			if (mynode->type == MULT) myargs->mult_use[i]++;
-		}
+	for (int i=mynode->asap_cycle;i<=mynode->alap_cycle;i++) {
+		if (mynode->type == ADD) myargs->add_use[i]++; else
+		if (mynode->type == MULT) myargs->mult_use[i]++;
+	}
+}
+
+// ADD and MULT nodes of the DAG
+void count_operations (dag *mydag,int *num_adds,int *num_mults) {
+	*num_adds = *num_mults = 0;
 	
-		mynode->flag=1;
+	for (int i=0;i<mydag->num_nodes;i++) {
+		if (mydag->nodes[i].type == ADD) (*num_adds)++;
+		if (mydag->nodes[i].type == MULT) (*num_mults)++;
 	}
 }
 
@@ -525,61 +634,51 @@ void generate_hls_wrapper_code(const char *filename,node **layers) {
 }
 
 void count_registers (node *mynode,void *args) {
-	if (!mynode->flag) {
-		
-		int start_cycle = mynode->scheduled_cycle;
-		int latency = LATENCY(mynode->type);
-		start_cycle += latency;
-		int end_cycle = start_cycle;
+	int start_cycle = mynode->scheduled_cycle;
+	int latency = NODE_LATENCY(mynode);
+	start_cycle += latency;
+	int end_cycle = start_cycle;
+	
+	// check all outgoing edges
+	for (int i=0;i<NUM_OUT_EDGES(mynode);i++) {
+		node *succ = OUT_NODE(mynode,i);
 		
-		// check all outgoing edges
-		edge *myedge = mynode->out_edges;
-		while (myedge) {
-			// find all cycles where output value is held
-			
-			if (myedge->edge->scheduled_cycle > end_cycle) end_cycle = myedge->edge->scheduled_cycle;
-			
-			//printf("%d -> %d cycles %d to %d\n",mynode->id,myedge->edge->id,start_cycle,end_cycle);
-			
-			myedge = myedge->next;
-		}
+		// find all cycles where output value is held
 		
-		for (int i=start_cycle;i<end_cycle;i++)	((register_table *)args)->register_usage_by_cycle[i]++;
+		if (succ->scheduled_cycle > end_cycle) end_cycle = succ->scheduled_cycle;
 		
-		mynode->flag=1;
+		//printf("%d -> %d cycles %d to %d\n",mynode->id,succ->id,start_cycle,end_cycle);
 	}
+	
+	for (int i=start_cycle;i<end_cycle;i++)	((register_table *)args)->register_usage_by_cycle[i]++;
 }
 
 void gen_shift_registers (node *mynode,void *args) {
 	int depth = ((argstype *)args)->shift_reg_depth;
 	FILE *myFile = ((argstype *)args)->file;
 	
-	if (!mynode->flag) {
-		// check if this is a final adder
-		if (mynode->final_adder || mynode->type==INPUT) {
-			// print declarations
-			fprintf(myFile,"\tstatic %s ",DATATYPE);
-			for (int i=0;i<=depth;i++) {
-				if (i) fprintf(myFile,",");
-				fprintf(myFile,"node%d_d%d",mynode->id,i);
-			}
-			fprintf(myFile,";\n");
-			
-			// print shift register
-			for (int i=depth-1;i>=-1;i--) {
-				if (i>=0)
-					fprintf(myFile,"\tnode%d_d%d = node%d_d%d;\n",mynode->id,i+1,
-																  mynode->id,i);
-				else if (mynode->type == INPUT)
-					fprintf(myFile,"\tnode%d_d%d = input%d;\n",mynode->id,i+1,
-															  mynode->id);
-				else	
-					fprintf(myFile,"\tnode%d_d%d = node%d;\n",mynode->id,i+1,
-																  mynode->id);
-			}
+	// check if this is a final adder
+	if (mynode->final_adder || mynode->type==INPUT) {
+		// print declarations
+		fprintf(myFile,"\tstatic %s ",DATATYPE);
+		for (int i=0;i<=depth;i++) {
+			if (i) fprintf(myFile,",");
+			fprintf(myFile,"node%d_d%d",mynode->id,i);
 		}
+		fprintf(myFile,";\n");
 		
-		mynode->flag=1;
+		// print shift register
+		for (int i=depth-1;i>=-1;i--) {
+			if (i>=0)
+				fprintf(myFile,"\tnode%d_d%d = node%d_d%d;\n",mynode->id,i+1,
+															  mynode->id,i);
+			else if (mynode->type == INPUT)
+				fprintf(myFile,"\tnode%d_d%d = input%d;\n",mynode->id,i+1,
+														  mynode->id);
+			else	
+				fprintf(myFile,"\tnode%d_d%d = node%d;\n",mynode->id,i+1,
+															  mynode->id);
+		}
 	}
 }
 
@@ -592,15 +691,6 @@ void tabulate_registers (node *layers[],int num_layers,int num_inputs,int num_ou
 	myregistertable.register_usage_by_cycle = (int *)malloc(sizeof(int)*num_cycles);
 	for (int i=0;i<num_cycles;i++) myregistertable.register_usage_by_cycle[i]=0;
 		
-	// clear flags
-	traverse_dag (layers,
-			  num_layers,
-			  num_inputs,
-			  num_outputs,
-			  NULL,
-			  clear_flags,
-			  FROM_START);
-	
 	// tally registers
 	traverse_dag (layers,
 				  num_layers,
@@ -725,7 +815,7 @@ void gen_c_code_loop_version (node **layers,
 		fprintf(myFile,"// limit the number of functional units to avoid oversubscription\n"
 					   "#pragma HLS ALLOCATION instances=mul limit=%d operation\n"
 					   "#pragma HLS ALLOCATION instances=add limit=%d operation\n"
-					   "#pragma HLS ALLOCATION instances=sub limit=%d operation\n\n",NUM_MULTIPLIERS,NUM_ADDERS,NUM_ADDERS);
+					   "#pragma HLS ALLOCATION instances=sub limit=%d operation\n\n",schedule_multipliers,schedule_adders,schedule_adders);
 		
 		// GENERATE COEFFICIENTS WITH INITIALIZATION
 		// forward pass 1 coefficients
@@ -1015,8 +1105,6 @@ void gen_c_code (node **layers,
 #ifndef ONLINE_TRAINING
 	myargs.shift_reg_depth=0;
 #endif
-	// clear flags, so we declare each variable only once
-	traverse_dag(layers,num_layers,num_inputs,num_outputs,(void *)&myargs,clear_flags,FROM_START);
 	traverse_dag(layers,num_layers,num_inputs,num_outputs,(void *)&myargs,gen_c_declarations,FROM_START);
 	fseek(myFile,-1,SEEK_CUR);
 	fprintf(myFile,";\n");
@@ -1025,7 +1113,6 @@ void gen_c_code (node **layers,
 		// STEP 6A:  GENERATE SECONDARY FORWARD PROP VARIABLES
 		fprintf(myFile,"\t%s ",DATATYPE);
 		myargs.secondforward=1;
-		traverse_dag(layers,num_layers,num_inputs,num_outputs,(void *)&myargs,clear_flags,FROM_START);
 		traverse_dag(layers,num_layers,num_inputs,num_outputs,(void *)&myargs,gen_c_declarations,FROM_START);
 		fseek(myFile,-1,SEEK_CUR);
 		fprintf(myFile,";\n");
@@ -1044,7 +1131,6 @@ void gen_c_code (node **layers,
 		myargs.secondforward=0;
 		myargs.gen_backwards=1;
 		// generate backprop and weight update code
-		traverse_dag(back_layers,num_layers,num_inputs,num_outputs,(void *)&myargs,clear_flags,FROM_START);
 		traverse_dag(back_layers,num_layers,num_outputs,num_inputs,(void *)&myargs,gen_c_declarations,FROM_START);
 		
 		// delete previous comma
@@ -1053,12 +1139,10 @@ void gen_c_code (node **layers,
 		
 		/*
 		// generate the shift registers
-		traverse_dag(layers,num_layers,num_inputs,num_outputs,(void *)&myargs,clear_flags,FROM_START);
 		traverse_dag(layers,num_layers,num_inputs,num_outputs,(void *)&myargs,gen_shift_registers,FROM_START);
 		*/
 		
 		// GENERATE SHIFT REGISTERS FOR INPUTS
-		traverse_dag(layers,num_layers,num_inputs,num_outputs,(void *)&myargs,clear_flags,FROM_START);
 		fprintf(myFile,"\n\t// generate shift registers for inputs\n");
 		mynode = layers[0];
 		for (int i=0;i<num_inputs;i++) {
@@ -1081,7 +1165,6 @@ void gen_c_code (node **layers,
 	fprintf(myFile,"\n\t// forward pass code\n");
 	myargs.backprop=0;
 	myargs.secondforward=0;
-	traverse_dag(layers,num_layers,num_inputs,num_outputs,(void *)&myargs,clear_flags,FROM_START);
 	traverse_dag(layers,num_layers,num_inputs,num_outputs,(void *)&myargs,gen_c_statement,FROM_START);
 	
 	if (gen_backprop) {
@@ -1089,14 +1172,12 @@ void gen_c_code (node **layers,
 		fprintf(myFile,"\n\t// secondary forward pass code\n");
 		myargs.backprop=0;
 		myargs.secondforward=1;
-		traverse_dag(layers,num_layers,num_inputs,num_outputs,(void *)&myargs,clear_flags,FROM_START);
 		traverse_dag(layers,num_layers,num_inputs,num_outputs,(void *)&myargs,gen_c_statement,FROM_START);
 		
 		// STEP 9:  GENERATE BACKPROP PASS
 		fprintf(myFile,"\n\t// backpropagation code\n");
 		myargs.backprop=1;
 		myargs.secondforward=0;
-		traverse_dag(back_layers,num_layers,num_outputs,num_inputs,(void *)&myargs,clear_flags,FROM_START);
 		traverse_dag(back_layers,num_layers,num_outputs,num_inputs,(void *)&myargs,gen_c_statement,FROM_START);
 	}
 	
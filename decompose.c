@@ -0,0 +1,324 @@
+#include "netscheduler.h"
+
+// layer-decomposed (rolling horizon) scheduling: the DAG is scheduled one
+// window of DECOMPOSE_WINDOW layers at a time, and only the first
+// DECOMPOSE_STEP layers of each window are kept before the window moves on.
+// every window is a small DAG of its own, so the usual machinery (timing,
+// heuristics, ILP writer and solver) applies to it unchanged:
+//
+// - nodes already scheduled that occupy a unit in the cycles the window may
+//   use (even if they started before them) are copied in as frozen nodes
+//   (window asap..alap collapsed onto their cycle), so they hold on to their
+//   functional units
+// - the operands produced by earlier windows become release cycles
+// - the window's last nodes feed a sink, whose start is the window's latency
+
+typedef struct {
+	dag *sub;
+	node_idx *sub_index;	// window DAG index of each node, NO_NODE if outside
+	node_idx *orig_index;	// DAG index of each window DAG node
+	int *release;			// per window DAG node
+	int *frozen;			// per window DAG node
+	node *sink;
+} window_dag;
+
+// does a scheduled node still occupy its unit at window_start or later?
+static int holds_unit (node *mynode,int start,int window_start) {
+	return start >= 0 && (mynode->type == ADD || mynode->type == MULT) && start + OCCUPANCY(mynode->type) > window_start;
+}
+
+// build the window DAG of the unscheduled nodes in layers first..last-1
+static void build_window (dag *mydag,int first,int last,const int *start,window_dag *w) {
+	int n = mydag->num_nodes;
+	int num_window=0,num_edges=0,window_start=-1;
+	
+	w->sub_index = (node_idx *)malloc(sizeof(node_idx)*(n ? n : 1));
+	for (int i=0;i<n;i++) w->sub_index[i] = NO_NODE;
+	
+	// the window's nodes, and the earliest cycle any of them can start
+	for (int i=0;i<n;i++) {
+		node *mynode = &mydag->nodes[i];
+		int ready=0;
+		
+		if (start[i] >= 0 || mynode->layer < first || mynode->layer >= last) continue;
+		
+		for (int j=0;j<NUM_IN_EDGES(mynode);j++) {
+			node *pred = IN_NODE(mynode,j);
+			if (start[pred->index] >= 0 && start[pred->index] + NODE_LATENCY(pred) > ready)
+				ready = start[pred->index] + NODE_LATENCY(pred);
+		}
+		
+		if (window_start < 0 || ready < window_start) window_start = ready;
+		w->sub_index[i] = num_window++;
+		num_edges += NUM_IN_EDGES(mynode) + 1;
+	}
+	
+	if (window_start < 0) window_start = INT32_MAX;
+	
+	// scheduled ADD and MULT nodes busy from there on are frozen
+	int num_frozen=0;
+	for (int i=0;i<n;i++)
+		if (holds_unit(&mydag->nodes[i],start[i],window_start)) num_frozen++;
+	
+	int num_nodes = num_window + num_frozen + 1;
+	w->sub = create_dag(num_nodes,num_edges);
+	w->orig_index = (node_idx *)malloc(sizeof(node_idx)*num_nodes);
+	w->release = (int *)calloc(num_nodes,sizeof(int));
+	w->frozen = (int *)calloc(num_nodes,sizeof(int));
+	
+	for (int i=0;i<n;i++) {
+		node *mynode = &mydag->nodes[i];
+		int is_frozen = holds_unit(mynode,start[i],window_start);
+		
+		if (w->sub_index[i] == NO_NODE && !is_frozen) continue;
+		
+		node *copy = create_node(w->sub,mynode->type,mynode->id);
+		copy->layer = mynode->layer;
+		copy->neuron = mynode->neuron;
+		copy->chained = mynode->chained;
+		w->sub_index[i] = copy->index;
+		w->orig_index[copy->index] = i;
+		if (is_frozen) {
+			w->frozen[copy->index] = 1;
+			w->release[copy->index] = start[i];
+		}
+	}
+	
+	// unused ids name the sink
+	w->sink = create_node(w->sub,OUTPUT,mydag->id_index_size);
+	w->sink->layer = last;
+	w->orig_index[w->sink->index] = NO_NODE;
+	
+	for (int i=0;i<n;i++) {
+		node *mynode = &mydag->nodes[i];
+		node_idx v = w->sub_index[i];
+		int has_successor=0;
+		
+		if (v == NO_NODE || w->frozen[v]) continue;
+		
+		for (int j=0;j<NUM_IN_EDGES(mynode);j++) {
+			node *pred = IN_NODE(mynode,j);
+			node_idx u = w->sub_index[pred->index];
+			
+			if (start[pred->index] >= 0 && start[pred->index] + NODE_LATENCY(pred) > w->release[v])
+				w->release[v] = start[pred->index] + NODE_LATENCY(pred);
+			if (u != NO_NODE) connect_nodes(&w->sub->nodes[u],&w->sub->nodes[v],IN_EDGE(mynode,j).input_num);
+		}
+		
+		for (int j=0;j<NUM_OUT_EDGES(mynode);j++) {
+			node_idx s = w->sub_index[OUT_NODE(mynode,j)->index];
+			if (s != NO_NODE && !w->frozen[s]) has_successor=1;
+		}
+		if (!has_successor) connect_nodes(&w->sub->nodes[v],w->sink,0);
+	}
+	
+	build_csr(w->sub);
+}
+
+static void free_window (window_dag *w) {
+	free_dag(w->sub);
+	free(w->sub_index);
+	free(w->orig_index);
+	free(w->release);
+	free(w->frozen);
+}
+
+// window ASAP from the release cycles, and ALAP from the sink's bound
+static void time_window (window_dag *w,int sink_alap) {
+	dag *sub = w->sub;
+	node_idx *order = topological_order(sub);
+	
+	for (int i=0;i<sub->num_nodes;i++) {
+		node *mynode = &sub->nodes[order[i]];
+		
+		mynode->asap_cycle = w->release[mynode->index];
+		for (int j=0;j<NUM_IN_EDGES(mynode);j++) {
+			node *pred = IN_NODE(mynode,j);
+			if (pred->asap_cycle + NODE_LATENCY(pred) > mynode->asap_cycle)
+				mynode->asap_cycle = pred->asap_cycle + NODE_LATENCY(pred);
+		}
+		if (w->frozen[mynode->index]) mynode->asap_cycle = w->release[mynode->index];
+	}
+	
+	w->sink->alap_cycle = sink_alap < w->sink->asap_cycle ? w->sink->asap_cycle : sink_alap;
+	
+	for (int i=sub->num_nodes-1;i>=0;i--) {
+		node *mynode = &sub->nodes[order[i]];
+		
+		if (mynode == w->sink) continue;
+		if (w->frozen[mynode->index] || !NUM_OUT_EDGES(mynode)) {
+			mynode->alap_cycle = mynode->asap_cycle;
+			continue;
+		}
+		
+		mynode->alap_cycle = -1;
+		for (int j=0;j<NUM_OUT_EDGES(mynode);j++) {
+			node *succ = OUT_NODE(mynode,j);
+			if (mynode->alap_cycle < 0 || succ->alap_cycle - NODE_LATENCY(mynode) < mynode->alap_cycle)
+				mynode->alap_cycle = succ->alap_cycle - NODE_LATENCY(mynode);
+		}
+	}
+	
+	sub->timed = 1;
+}
+
+// schedule one window into the nodes' scheduled cycles: list scheduling,
+// then (optionally) the ILP bounded by and started from the list schedule.
+// status tells how the ILP ended
+static int solve_window (window_dag *w,int use_ilp,const char *lp_filename,solver_status *status) {
+	dag *sub = w->sub;
+	int n = sub->num_nodes;
+	int *priority = (int *)malloc(sizeof(int)*n);
+	int *sub_start = (int *)malloc(sizeof(int)*n);
+	
+	time_window(w,INT32_MAX);
+	time_window(w,w->sink->asap_cycle + schedule_slack);
+	
+	// frozen nodes keep their cycle and hold their units in it
+	for (int i=0;i<n;i++) priority[i] = sub->nodes[i].alap_cycle;
+	list_schedule_released(sub,priority,w->release,w->frozen,schedule_adders,schedule_multipliers,sub_start);
+	
+	for (int i=0;i<n;i++) sub->nodes[i].scheduled_cycle = sub_start[i];
+	int latency = sub_start[w->sink->index];
+	
+	if (use_ilp) {
+		node *sub_layers[2] = {&sub->nodes[0],w->sink};
+		argstype myargs;
+		
+		// the list schedule bounds the windows, and stays in the nodes as
+		// the MIP start (and as the result, if the solver gives no answer)
+		time_window(w,latency);
+		
+		compute_functional_utilization(sub_layers,1,0,0,&myargs);
+		generate_ilp_file(sub_layers,1,0,0,(char *)lp_filename,&myargs);
+		free(myargs.add_use);
+		free(myargs.mult_use);
+		
+		// the jobs run concurrently, so not through schedule_status
+		int solved = solve_schedule_status(sub_layers,1,0,0,(char *)lp_filename,status);
+		if (solved >= 0) latency = solved;
+	}
+	
+	free(priority);
+	free(sub_start);
+	
+	return latency;
+}
+
+// lower bound on the latency: the critical path, and the number of cycles
+// the units need for all operations
+static int latency_lower_bound (dag *mydag) {
+	int bound=0,num_adds=0,num_mults=0;
+	
+	for (int i=0;i<mydag->num_nodes;i++) {
+		node *mynode = &mydag->nodes[i];
+		
+		if (mynode->type == ADD) num_adds++;
+		if (mynode->type == MULT) num_mults++;
+		if (!NUM_OUT_EDGES(mynode) && mynode->asap_cycle > bound) bound = mynode->asap_cycle;
+	}
+	
+	if (unit_latency_bound(num_adds,ADD,schedule_adders) > bound) bound = unit_latency_bound(num_adds,ADD,schedule_adders);
+	if (unit_latency_bound(num_mults,MULT,schedule_multipliers) > bound) bound = unit_latency_bound(num_mults,MULT,schedule_multipliers);
+	
+	return bound;
+}
+
+// schedule the DAG window by window (see above).  the subproblems are named
+// after the prefix.  fills in the latency, its lower bound and the windows
+// solved
+void decompose_schedule (decompose_job *job) {
+	dag *mydag = job->layers[0]->graph;
+	int n = mydag->num_nodes;
+	int *start = (int *)malloc(sizeof(int)*(n ? n : 1));
+	int num_layers = job->num_layers+1;
+	char lp_filename[1024];
+	struct timespec begin,end;
+	
+	clock_gettime(CLOCK_MONOTONIC,&begin);
+	
+#ifdef CHAIN_OPERATIONS
+	// the windows keep the chains of the whole DAG
+	if (!mydag->timed) chain_operations(mydag);
+#endif
+	
+	for (int i=0;i<n;i++) start[i] = -1;
+	job->num_windows = job->optimal_windows = 0;
+	
+	for (int first=0;first<num_layers;first+=DECOMPOSE_STEP) {
+		int last = first+DECOMPOSE_WINDOW < num_layers ? first+DECOMPOSE_WINDOW : num_layers;
+		int keep = last == num_layers ? last : first+DECOMPOSE_STEP;
+		window_dag w;
+		solver_status status = SOLVER_UNSOLVED;
+		
+		build_window(mydag,first,last,start,&w);
+		snprintf(lp_filename,1024,"%s_%d.lp",job->prefix,first);
+		int latency = solve_window(&w,job->use_ilp,lp_filename,&status);
+		job->num_windows++;
+		if (job->use_ilp && status == SOLVER_OPTIMAL) job->optimal_windows++;
+		
+		// keep the first layers of the window
+		for (int i=0;i<w.sub->num_nodes;i++) {
+			node_idx orig = w.orig_index[i];
+			if (orig != NO_NODE && !w.frozen[i] && mydag->nodes[orig].layer < keep)
+				start[orig] = w.sub->nodes[i].scheduled_cycle;
+		}
+		
+		logmsg("%s: layers %d-%d scheduled in %d cycles (%d nodes)",job->prefix,first,last-1,latency,w.sub->num_nodes);
+		free_window(&w);
+		
+		if (last == num_layers) break;
+	}
+	
+	// the ASAPs are only needed for the bound
+	if (!mydag->timed) compute_timing(mydag,FROM_START);
+	
+	job->latency = 0;
+	for (int i=0;i<n;i++) {
+		mydag->nodes[i].scheduled_cycle = start[i];
+		if (!NUM_OUT_EDGES(&mydag->nodes[i]) && start[i] > job->latency) job->latency = start[i];
+	}
+	job->lower_bound = latency_lower_bound(mydag);
+	
+	clock_gettime(CLOCK_MONOTONIC,&end);
+	job->ms = (end.tv_sec - begin.tv_sec)*1e3 + (end.tv_nsec - begin.tv_nsec)*1e-6;
+	
+	free(start);
+}
+
+static void *decompose_worker (void *args) {
+	decompose_job *job = (decompose_job *)args;
+	
+	decompose_schedule(job);
+	
+	return NULL;
+}
+
+// schedule independent DAGs concurrently, one thread each, and report the
+// gap of each schedule to its lower bound
+void decompose_schedule_jobs (decompose_job *jobs,int num_jobs) {
+	pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t)*num_jobs);
+	
+	for (int i=0;i<num_jobs;i++) {
+		if (pthread_create(&threads[i],NULL,decompose_worker,&jobs[i])) {
+			perror("Fatal: pthread_create");
+			exit(1);
+		}
+	}
+	for (int i=0;i<num_jobs;i++) pthread_join(threads[i],NULL);
+	
+	free(threads);
+	
+	printf ("Decomposed schedules (window %d layers, step %d)\n"
+	        "--------------------\n",DECOMPOSE_WINDOW,DECOMPOSE_STEP);
+	printf ("%20s%12s%12s%12s%12s%12s\n","DAG","latency","bound","gap %","ms","optimal");
+	for (int i=0;i<num_jobs;i++) {
+		decompose_job *job = &jobs[i];
+		float gap = job->latency ? 100.f*(job->latency - job->lower_bound)/job->latency : 0.f;
+		char optimal[32] = "-";
+		
+		// windows the ILP proved optimal
+		if (job->use_ilp) snprintf(optimal,32,"%d/%d",job->optimal_windows,job->num_windows);
+		printf ("%20s%12d%12d%12.1f%12.1f%12s\n",job->prefix,job->latency,job->lower_bound,gap,job->ms,optimal);
+	}
+}
@@ -0,0 +1,265 @@
+#include "netscheduler.h"
+
+// in-process solver backend: the same ILP that generate_ilp_file() writes is
+// built directly as a sparse matrix through the GLPK API, solved with
+// glp_intopt() and read straight back into the nodes, so no LP text is
+// formatted, written, re-parsed or scanned for the solution
+
+#ifdef USE_GLPK_API
+
+// the columns of a node are its cycles asap..alap, starting at col[index]
+#define GLPK_COL(col,mynode,cycle)	((col)[(mynode)->index] + (cycle) - (mynode)->asap_cycle)
+#define WINDOW(mynode)				((mynode)->alap_cycle - (mynode)->asap_cycle + 1)
+
+// append one coefficient of the constraint matrix (zeros are left out)
+#define GLPK_ELEMENT(row,column,value) do { \
+	if (value) { \
+		ne++; \
+		ia[ne] = (row); \
+		ja[ne] = (column); \
+		ar[ne] = (value); \
+	} \
+} while (0)
+
+// offers the DAG's current schedule to the branch-and-cut as an integer
+// feasible solution, the first time it asks for a heuristic one
+typedef struct {
+	double *x;
+	int offered;
+} glpk_start;
+
+static void glpk_callback (glp_tree *tree,void *info) {
+	glpk_start *mystart = (glpk_start *)info;
+	
+	if (glp_ios_reason(tree) == GLP_IHEUR && !mystart->offered) {
+		mystart->offered = 1;
+		glp_ios_heur_sol(tree,mystart->x);
+	}
+}
+
+// returns the latency, SCHEDULE_INFEASIBLE if glp_intopt() proved there is
+// no schedule, or SCHEDULE_UNSOLVED if it stopped without one
+int solve_schedule_glpk (node **layers,
+						int num_layers,
+						int num_inputs,
+						int num_outputs) {
+	
+	if (schedule_formulation != ILP_TIME_INDEXED) {
+		fprintf(stderr,"Fatal: the in-process solver only builds the time-indexed ILP formulation.\n");
+		exit(1);
+	}
+	if (schedule_registers != REGISTERS_NONE) {
+		fprintf(stderr,"Fatal: the in-process solver has no register pressure objective.\n");
+		exit(1);
+	}
+	
+	dag *mydag = layers[0]->graph;
+	int n = mydag->num_nodes;
+	int last_cycle = layers[num_layers]->alap_cycle;
+	int busy_cycle = last_cycle + (OCCUPANCY(ADD) > OCCUPANCY(MULT) ? OCCUPANCY(ADD) : OCCUPANCY(MULT)) - 1;
+	int *col = (int *)malloc(sizeof(int)*(n+1));
+	int *add_use = (int *)calloc(busy_cycle+1,sizeof(int));
+	int *mult_use = (int *)calloc(busy_cycle+1,sizeof(int));
+	int *add_row = (int *)calloc(busy_cycle+1,sizeof(int));
+	int *mult_row = (int *)calloc(busy_cycle+1,sizeof(int));
+	int num_cols=0,num_rows=0,ne=0;
+	long max_ne=0;
+	
+	// number the columns and count the potential functional utilization
+	for (int i=0;i<n;i++) {
+		node *mynode = &mydag->nodes[i];
+		
+		col[i] = num_cols+1;
+		num_cols += WINDOW(mynode);
+		max_ne += WINDOW(mynode);
+		
+		for (int j=0;j<NUM_IN_EDGES(mynode);j++)
+			max_ne += WINDOW(mynode) + WINDOW(IN_NODE(mynode,j));
+		
+		for (int c=mynode->asap_cycle;c<=mynode->alap_cycle;c++) {
+			if (mynode->type == ADD) occupy_unit(add_use,ADD,schedule_ii,c,1); else
+			if (mynode->type == MULT) occupy_unit(mult_use,MULT,schedule_ii,c,1);
+		}
+		
+		if (mynode->type == ADD || mynode->type == MULT) max_ne += WINDOW(mynode)*OCCUPIED_SLOTS(mynode->type,schedule_ii);
+	}
+	
+	glp_prob *lp = glp_create_prob();
+	glp_set_prob_name(lp,"schedule");
+	glp_set_obj_dir(lp,GLP_MIN);
+	
+	glp_add_cols(lp,num_cols);
+	for (int j=1;j<=num_cols;j++) glp_set_col_kind(lp,j,GLP_BV);
+	
+	// latency objective
+	node *final = layers[num_layers];
+	for (int c=final->asap_cycle;c<=final->alap_cycle;c++)
+		glp_set_obj_coef(lp,GLPK_COL(col,final,c),c);
+	
+	// one row per start time constraint, per dependency and per cycle (or
+	// slot of the initiation interval) in which a resource may be
+	// oversubscribed
+	for (int i=0;i<n;i++) num_rows += 1 + NUM_IN_EDGES(&mydag->nodes[i]);
+	for (int c=0;c<RESOURCE_SLOTS(busy_cycle);c++) {
+		if (mult_use[c] > schedule_multipliers) mult_row[c] = ++num_rows;
+		if (add_use[c] > schedule_adders) add_row[c] = ++num_rows;
+	}
+#ifdef NEURON_SYMMETRY_BREAKING
+	node_idx *pairs;
+	int num_pairs = neuron_symmetry_pairs(mydag,&pairs);
+	int symmetry_row = num_rows;
+	
+	num_rows += num_pairs;
+	for (int i=0;i<num_pairs;i++) max_ne += WINDOW(&mydag->nodes[pairs[2*i]]) + WINDOW(&mydag->nodes[pairs[2*i+1]]);
+#endif
+	glp_add_rows(lp,num_rows);
+	
+	int *ia = (int *)malloc(sizeof(int)*(max_ne+1));
+	int *ja = (int *)malloc(sizeof(int)*(max_ne+1));
+	double *ar = (double *)malloc(sizeof(double)*(max_ne+1));
+	if (!ia || !ja || !ar) {
+		fprintf(stderr,"ERROR: out of memory for %ld constraint coefficients\n",max_ne);
+		exit(1);
+	}
+	
+	int row=0;
+	for (int i=0;i<n;i++) {
+		node *mynode = &mydag->nodes[i];
+		
+		// start time constraint
+		glp_set_row_bnds(lp,++row,GLP_FX,1.0,1.0);
+		for (int c=mynode->asap_cycle;c<=mynode->alap_cycle;c++)
+			GLPK_ELEMENT(row,GLPK_COL(col,mynode,c),1.0);
+		
+		// data dependency constraints
+		for (int j=0;j<NUM_IN_EDGES(mynode);j++) {
+			node *pred = IN_NODE(mynode,j);
+			
+			glp_set_row_bnds(lp,++row,GLP_LO,NODE_LATENCY(pred),0.0);
+			for (int c=mynode->asap_cycle;c<=mynode->alap_cycle;c++)
+				GLPK_ELEMENT(row,GLPK_COL(col,mynode,c),(double)c);
+			for (int c=pred->asap_cycle;c<=pred->alap_cycle;c++)
+				GLPK_ELEMENT(row,GLPK_COL(col,pred,c),-(double)c);
+		}
+		
+		// resource constraints, over the cycles the node would occupy its unit
+		for (int c=mynode->asap_cycle;c<=mynode->alap_cycle;c++) {
+			for (int k=0;k<OCCUPIED_SLOTS(mynode->type,schedule_ii);k++) {
+				int slot = RESOURCE_SLOT(c+k);
+				double weight = SLOT_WEIGHT(mynode->type,schedule_ii,k);
+				
+				if (mynode->type == MULT && mult_row[slot]) GLPK_ELEMENT(mult_row[slot],GLPK_COL(col,mynode,c),weight);
+				if (mynode->type == ADD && add_row[slot]) GLPK_ELEMENT(add_row[slot],GLPK_COL(col,mynode,c),weight);
+			}
+		}
+	}
+	
+	for (int c=0;c<RESOURCE_SLOTS(busy_cycle);c++) {
+		if (mult_row[c]) glp_set_row_bnds(lp,mult_row[c],GLP_UP,0.0,schedule_multipliers);
+		if (add_row[c]) glp_set_row_bnds(lp,add_row[c],GLP_UP,0.0,schedule_adders);
+	}
+	
+#ifdef NEURON_SYMMETRY_BREAKING
+	// symmetry breaking constraints
+	for (int i=0;i<num_pairs;i++) {
+		node *first = &mydag->nodes[pairs[2*i]];
+		node *second = &mydag->nodes[pairs[2*i+1]];
+		
+		glp_set_row_bnds(lp,++symmetry_row,GLP_UP,0.0,0.0);
+		for (int c=first->asap_cycle;c<=first->alap_cycle;c++)
+			GLPK_ELEMENT(symmetry_row,GLPK_COL(col,first,c),(double)c);
+		for (int c=second->asap_cycle;c<=second->alap_cycle;c++)
+			GLPK_ELEMENT(symmetry_row,GLPK_COL(col,second,c),-(double)c);
+	}
+	free(pairs);
+#endif
+	
+	glp_load_matrix(lp,ne,ia,ja,ar);
+	free(ia);
+	free(ja);
+	free(ar);
+	
+	logmsg("Solving ILP in-process (%d variables, %d constraints, %d coefficients)",num_cols,num_rows,ne);
+	
+	// same limits as the glpsol command line
+	glp_iocp parm;
+	glp_init_iocp(&parm);
+	parm.presolve = GLP_ON;
+	parm.tm_lim = 36000*1000;
+	
+	// a schedule already in the DAG (e.g. from heuristic_schedule()) is the
+	// MIP start, if it lies inside the windows
+	glpk_start mystart;
+	mystart.x = NULL;
+	mystart.offered = 0;
+	if (final->scheduled_cycle >= 0) {
+		mystart.x = (double *)calloc(num_cols+1,sizeof(double));
+		for (int i=0;i<n && mystart.x;i++) {
+			node *mynode = &mydag->nodes[i];
+			
+			if (mynode->scheduled_cycle < mynode->asap_cycle || mynode->scheduled_cycle > mynode->alap_cycle) {
+				free(mystart.x);
+				mystart.x = NULL;
+			} else {
+				mystart.x[GLPK_COL(col,mynode,mynode->scheduled_cycle)] = 1.0;
+			}
+		}
+	}
+	
+	// the callback sees the presolved problem's columns, so with a start
+	// the relaxation is solved up front instead
+	if (mystart.x) {
+		glp_smcp smcp;
+		glp_init_smcp(&smcp);
+		smcp.presolve = GLP_ON;
+		glp_simplex(lp,&smcp);
+		
+		parm.presolve = GLP_OFF;
+		parm.cb_func = glpk_callback;
+		parm.cb_info = &mystart;
+	}
+	
+	int ret = glp_intopt(lp,&parm);
+	free(mystart.x);
+	int status = glp_mip_status(lp);
+	int solved = status == GLP_OPT || status == GLP_FEAS;
+	if (!solved) fprintf(stderr,"ERROR: no integer solution found (glp_intopt returned %d, status %d)\n",ret,status);
+	
+	// a time limit or gap stop keeps the solution found so far, which isn't
+	// proven optimal
+	schedule_status = status == GLP_OPT && !ret ? SOLVER_OPTIMAL :
+					  solved ? SOLVER_FEASIBLE :
+					  status == GLP_NOFEAS || ret == GLP_ENOPFS ? SOLVER_INFEASIBLE :
+					  SOLVER_UNSOLVED;
+	
+	// apply the solution
+	for (int i=0;i<n && solved;i++) {
+		node *mynode = &mydag->nodes[i];
+		
+		for (int c=mynode->asap_cycle;c<=mynode->alap_cycle;c++) {
+			if (glp_mip_col_val(lp,GLPK_COL(col,mynode,c)) > 0.5) {
+				mynode->scheduled_cycle = c;
+				break;
+			}
+		}
+	}
+	
+	glp_delete_prob(lp);
+	free(col);
+	free(add_use);
+	free(mult_use);
+	free(add_row);
+	free(mult_row);
+	
+	if (!solved) return schedule_status == SOLVER_INFEASIBLE ? SCHEDULE_INFEASIBLE : SCHEDULE_UNSOLVED;
+	
+	// find schedule latency
+	int max_latency=0;
+	for (node *mynode = layers[num_layers]; mynode; mynode=mynode->next) {
+		if (mynode->scheduled_cycle > max_latency) max_latency = mynode->scheduled_cycle;
+	}
+	
+	return max_latency;
+}
+
+#endif
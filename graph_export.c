@@ -0,0 +1,375 @@
+#include "netscheduler.h"
+
+// graph export: DOT, GraphML and GEXF writers that stream the DAG straight
+// into a large stdio buffer.  optionally, every neuron's multipliers and
+// adder tree are collapsed into one summary vertex, which keeps the output
+// of large networks small enough to lay out and view
+
+// one exported vertex: either a single node, or a neuron cluster summarized
+// by its final node
+typedef struct {
+	int id;
+	char name[64];
+	const char *opcode;
+	int asap;
+	int alap;
+	int sched_start;
+	int latency;
+	int layer;
+	int neuron;
+	int members;
+} graph_vertex;
+
+typedef struct {
+	int id;
+	int source;
+	int target;
+	int input_num;
+	int weight;
+} graph_edge;
+
+// the neuron clusters: every node belongs to the cluster of the final node
+// of its neuron, and inputs and outputs are clusters of their own
+typedef struct {
+	int num_clusters;
+	node_idx *cluster_of;
+	node_idx *rep;
+	node_idx *member_offset;
+	node_idx *members;
+} graph_clusters;
+
+static void find_clusters (dag *mydag,graph_clusters *clusters) {
+	int n = mydag->num_nodes;
+	node_idx *order = topological_order(mydag);
+	node_idx *cluster_of = clusters->cluster_of = (node_idx *)malloc(sizeof(node_idx)*(n ? n : 1));
+	
+	// inside a neuron each node has exactly one successor, so a reverse
+	// topological sweep pulls the cluster down from the final node
+	for (int i=n-1;i>=0;i--) {
+		node *mynode = &mydag->nodes[order[i]];
+	
+		if (mynode->final_adder || mynode->type == INPUT || mynode->type == OUTPUT || !NUM_OUT_EDGES(mynode))
+			cluster_of[mynode->index] = mynode->index;
+		else
+			cluster_of[mynode->index] = cluster_of[OUT_EDGE(mynode,0).node_index];
+	}
+	
+	// number the clusters densely, in node order of their final nodes
+	node_idx *number = (node_idx *)malloc(sizeof(node_idx)*(n ? n : 1));
+	clusters->num_clusters = 0;
+	for (int i=0;i<n;i++) if (cluster_of[i] == (node_idx)i) number[i] = clusters->num_clusters++;
+	
+	clusters->rep = (node_idx *)malloc(sizeof(node_idx)*(clusters->num_clusters ? clusters->num_clusters : 1));
+	clusters->member_offset = (node_idx *)calloc(clusters->num_clusters+1,sizeof(node_idx));
+	clusters->members = (node_idx *)malloc(sizeof(node_idx)*(n ? n : 1));
+	
+	for (int i=0;i<n;i++) {
+		if (cluster_of[i] == (node_idx)i) clusters->rep[number[i]] = i;
+		cluster_of[i] = number[cluster_of[i]];
+		clusters->member_offset[cluster_of[i]+1]++;
+	}
+	
+	for (int c=0;c<clusters->num_clusters;c++) clusters->member_offset[c+1] += clusters->member_offset[c];
+	
+	node_idx *fill = number;
+	memcpy(fill,clusters->member_offset,sizeof(node_idx)*clusters->num_clusters);
+	for (int i=0;i<n;i++) clusters->members[fill[cluster_of[i]]++] = i;
+	
+	free(number);
+}
+
+static void free_clusters (graph_clusters *clusters) {
+	free(clusters->cluster_of);
+	free(clusters->rep);
+	free(clusters->member_offset);
+	free(clusters->members);
+}
+
+static void node_vertex (node *mynode,graph_vertex *vertex) {
+	vertex->id = mynode->id;
+	snprintf(vertex->name,64,"%s_%d",NODETYPE(mynode->type),mynode->id);
+	vertex->opcode = NODETYPE(mynode->type);
+	vertex->asap = mynode->asap_cycle;
+	vertex->alap = mynode->alap_cycle;
+	vertex->sched_start = mynode->scheduled_cycle;
+	vertex->latency = NODE_LATENCY(mynode);
+	vertex->layer = mynode->layer;
+	vertex->neuron = mynode->neuron;
+	vertex->members = 1;
+}
+
+static void cluster_vertex (dag *mydag,graph_clusters *clusters,int c,graph_vertex *vertex) {
+	node *rep = &mydag->nodes[clusters->rep[c]];
+	int size = clusters->member_offset[c+1] - clusters->member_offset[c];
+	
+	node_vertex(rep,vertex);
+	if (size == 1) return;
+	
+	// a neuron spans from its earliest member to its final node
+	snprintf(vertex->name,64,"neuron_%d",rep->id);
+	vertex->opcode = "neuron";
+	vertex->members = size;
+	
+	for (node_idx i=clusters->member_offset[c];i<clusters->member_offset[c+1];i++) {
+		node *mynode = &mydag->nodes[clusters->members[i]];
+		if (mynode->asap_cycle < vertex->asap) vertex->asap = mynode->asap_cycle;
+		if (mynode->scheduled_cycle != -1 && (vertex->sched_start == -1 || mynode->scheduled_cycle < vertex->sched_start))
+			vertex->sched_start = mynode->scheduled_cycle;
+	}
+	
+	if (vertex->sched_start != -1) vertex->latency = rep->scheduled_cycle + NODE_LATENCY(rep) - vertex->sched_start;
+	else vertex->latency = rep->asap_cycle + NODE_LATENCY(rep) - vertex->asap;
+}
+
+static void write_header (FILE *myFile,graph_format format) {
+	switch (format) {
+		case GRAPH_DOT:
+			fprintf(myFile,"digraph {\nrankdir=LR;\n");
+			break;
+		case GRAPH_GRAPHML:
+			fprintf(myFile,"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+						   "<graphml xmlns=\"http://graphml.graphdrawing.org/xmlns\">\n"
+						   "<key id=\"name\" for=\"node\" attr.name=\"name\" attr.type=\"string\"/>\n"
+						   "<key id=\"opcode\" for=\"node\" attr.name=\"opcode\" attr.type=\"string\"/>\n"
+						   "<key id=\"sched_start\" for=\"node\" attr.name=\"sched_start\" attr.type=\"double\"/>\n"
+						   "<key id=\"asap\" for=\"node\" attr.name=\"asap\" attr.type=\"int\"/>\n"
+						   "<key id=\"alap\" for=\"node\" attr.name=\"alap\" attr.type=\"int\"/>\n"
+						   "<key id=\"latency\" for=\"node\" attr.name=\"latency\" attr.type=\"int\"/>\n"
+						   "<key id=\"layer\" for=\"node\" attr.name=\"layer\" attr.type=\"int\"/>\n"
+						   "<key id=\"neuron\" for=\"node\" attr.name=\"neuron\" attr.type=\"int\"/>\n"
+						   "<key id=\"members\" for=\"node\" attr.name=\"members\" attr.type=\"int\"/>\n"
+						   "<key id=\"input_num\" for=\"edge\" attr.name=\"input_num\" attr.type=\"int\"/>\n"
+						   "<key id=\"weight\" for=\"edge\" attr.name=\"weight\" attr.type=\"int\"/>\n"
+						   "<graph id=\"G\" edgedefault=\"directed\">\n");
+			break;
+		case GRAPH_GEXF:
+			fprintf(myFile,"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+						   "<gexf xmlns=\"http://www.gexf.net/1.2draft\" version=\"1.2\">\n"
+						   "<meta><creator>netscheduler</creator></meta>\n"
+						   "<graph defaultedgetype=\"directed\" mode=\"static\">\n"
+						   "<attributes class=\"node\" mode=\"static\">\n"
+						   "<attribute id=\"0\" title=\"name\" type=\"string\"/>\n"
+						   "<attribute id=\"1\" title=\"opcode\" type=\"string\"/>\n"
+						   "<attribute id=\"2\" title=\"sched_start\" type=\"double\"/>\n"
+						   "<attribute id=\"3\" title=\"asap\" type=\"integer\"/>\n"
+						   "<attribute id=\"4\" title=\"alap\" type=\"integer\"/>\n"
+						   "<attribute id=\"5\" title=\"latency\" type=\"integer\"/>\n"
+						   "<attribute id=\"6\" title=\"layer\" type=\"integer\"/>\n"
+						   "<attribute id=\"7\" title=\"neuron\" type=\"integer\"/>\n"
+						   "<attribute id=\"8\" title=\"members\" type=\"integer\"/>\n"
+						   "</attributes>\n"
+						   "<attributes class=\"edge\" mode=\"static\">\n"
+						   "<attribute id=\"0\" title=\"input_num\" type=\"integer\"/>\n"
+						   "</attributes>\n"
+						   "<nodes>\n");
+			break;
+	}
+}
+
+static void write_vertex (FILE *myFile,graph_format format,graph_vertex *vertex) {
+	switch (format) {
+		case GRAPH_DOT:
+			if (vertex->members > 1)
+				fprintf(myFile,"%s [shape=box3d fontsize=10 label=\"%s\\n%d nodes(%d,%d,%d)\"]\n",vertex->name,
+																							  vertex->name,
+																							  vertex->members,
+																							  vertex->asap,
+																							  vertex->alap,
+																							  vertex->sched_start);
+			else
+				fprintf(myFile,"%s [shape=%s fontsize=10 label=\"%s(%d,%d,%d)\"]\n",vertex->name,
+																				   !strcmp(vertex->opcode,"mult") ? "box" :
+																				   !strcmp(vertex->opcode,"add") ? "ellipse" :
+																				   !strcmp(vertex->opcode,"addbias") ? "square" : "cds",
+																				   vertex->name,
+																				   vertex->asap,
+																				   vertex->alap,
+																				   vertex->sched_start);
+			break;
+		case GRAPH_GRAPHML:
+			fprintf(myFile,"<node id=\"n%d\">"
+						   "<data key=\"name\">%s</data>"
+						   "<data key=\"opcode\">%s</data>"
+						   "<data key=\"sched_start\">%d</data>"
+						   "<data key=\"asap\">%d</data>"
+						   "<data key=\"alap\">%d</data>"
+						   "<data key=\"latency\">%d</data>"
+						   "<data key=\"layer\">%d</data>"
+						   "<data key=\"neuron\">%d</data>"
+						   "<data key=\"members\">%d</data>"
+						   "</node>\n",vertex->id,vertex->name,vertex->opcode,vertex->sched_start,vertex->asap,vertex->alap,
+									   vertex->latency,vertex->layer,vertex->neuron,vertex->members);
+			break;
+		case GRAPH_GEXF:
+			fprintf(myFile,"<node id=\"%d\" label=\"%s\"><attvalues>"
+						   "<attvalue for=\"0\" value=\"%s\"/>"
+						   "<attvalue for=\"1\" value=\"%s\"/>"
+						   "<attvalue for=\"2\" value=\"%d\"/>"
+						   "<attvalue for=\"3\" value=\"%d\"/>"
+						   "<attvalue for=\"4\" value=\"%d\"/>"
+						   "<attvalue for=\"5\" value=\"%d\"/>"
+						   "<attvalue for=\"6\" value=\"%d\"/>"
+						   "<attvalue for=\"7\" value=\"%d\"/>"
+						   "<attvalue for=\"8\" value=\"%d\"/>"
+						   "</attvalues></node>\n",vertex->id,vertex->name,vertex->name,vertex->opcode,vertex->sched_start,
+												   vertex->asap,vertex->alap,vertex->latency,vertex->layer,vertex->neuron,vertex->members);
+			break;
+	}
+}
+
+// GEXF keeps nodes and edges in separate sections
+static void write_edges_start (FILE *myFile,graph_format format) {
+	if (format == GRAPH_GEXF) fprintf(myFile,"</nodes>\n<edges>\n");
+}
+
+static void write_edge (FILE *myFile,graph_format format,graph_vertex *source,graph_vertex *target,graph_edge *myedge) {
+	switch (format) {
+		case GRAPH_DOT:
+			if (myedge->weight > 1)
+				fprintf(myFile,"%s -> %s [label=\"%d\"]\n",source->name,target->name,myedge->weight);
+			else
+				fprintf(myFile,"%s -> %s\n",source->name,target->name);
+			break;
+		case GRAPH_GRAPHML:
+			fprintf(myFile,"<edge id=\"e%d\" source=\"n%d\" target=\"n%d\">"
+						   "<data key=\"input_num\">%d</data>"
+						   "<data key=\"weight\">%d</data>"
+						   "</edge>\n",myedge->id,myedge->source,myedge->target,myedge->input_num,myedge->weight);
+			break;
+		case GRAPH_GEXF:
+			fprintf(myFile,"<edge id=\"%d\" source=\"%d\" target=\"%d\" weight=\"%d\"><attvalues>"
+						   "<attvalue for=\"0\" value=\"%d\"/>"
+						   "</attvalues></edge>\n",myedge->id,myedge->source,myedge->target,myedge->weight,myedge->input_num);
+			break;
+	}
+}
+
+static void write_footer (FILE *myFile,graph_format format) {
+	switch (format) {
+		case GRAPH_DOT:
+			fprintf(myFile,"}\n");
+			break;
+		case GRAPH_GRAPHML:
+			fprintf(myFile,"</graph>\n</graphml>\n");
+			break;
+		case GRAPH_GEXF:
+			fprintf(myFile,"</edges>\n</graph>\n</gexf>\n");
+			break;
+	}
+}
+
+void export_graph (node *layers[],FILE *myFile,graph_format format,int cluster_neurons) {
+	dag *mydag = layers[0]->graph;
+	node_idx *order = topological_order(mydag);
+	graph_vertex vertex,source;
+	graph_edge myedge;
+	int num_edges=0;
+	
+	write_header(myFile,format);
+	
+	if (!cluster_neurons) {
+		for (int i=0;i<mydag->num_nodes;i++) {
+			node_vertex(&mydag->nodes[order[i]],&vertex);
+			write_vertex(myFile,format,&vertex);
+		}
+	
+		write_edges_start(myFile,format);
+	
+		for (int i=0;i<mydag->num_nodes;i++) {
+			node *mynode = &mydag->nodes[order[i]];
+			node_vertex(mynode,&vertex);
+	
+			for (int j=0;j<NUM_IN_EDGES(mynode);j++) {
+				node_vertex(IN_NODE(mynode,j),&source);
+				myedge.id = num_edges++;
+				myedge.source = source.id;
+				myedge.target = vertex.id;
+				myedge.input_num = IN_EDGE(mynode,j).input_num;
+				myedge.weight = 1;
+				write_edge(myFile,format,&source,&vertex,&myedge);
+			}
+	
+			// line up the operands of each node (streamed, so any fan-in fits)
+			if (format == GRAPH_DOT && NUM_IN_EDGES(mynode)) {
+				fprintf(myFile,"{rank=same; ");
+				for (int j=0;j<NUM_IN_EDGES(mynode);j++)
+					fprintf(myFile,"%s_%d; ",NODETYPE(IN_NODE(mynode,j)->type),IN_NODE(mynode,j)->id);
+				fprintf(myFile,"}\n");
+			}
+		}
+	
+		write_footer(myFile,format);
+		return;
+	}
+	
+	graph_clusters clusters;
+	find_clusters(mydag,&clusters);
+	
+	graph_vertex *vertices = (graph_vertex *)malloc(sizeof(graph_vertex)*(clusters.num_clusters ? clusters.num_clusters : 1));
+	for (int c=0;c<clusters.num_clusters;c++) {
+		cluster_vertex(mydag,&clusters,c,&vertices[c]);
+		write_vertex(myFile,format,&vertices[c]);
+	}
+	
+	write_edges_start(myFile,format);
+	
+	// merge the edges between each pair of clusters into one edge, weighted by
+	// the number of edges it stands for
+	int *weight = (int *)calloc(clusters.num_clusters ? clusters.num_clusters : 1,sizeof(int));
+	int *sources = (int *)malloc(sizeof(int)*(clusters.num_clusters ? clusters.num_clusters : 1));
+	int *first_input = (int *)malloc(sizeof(int)*(clusters.num_clusters ? clusters.num_clusters : 1));
+	
+	for (int c=0;c<clusters.num_clusters;c++) {
+		int num_sources=0;
+	
+		for (node_idx i=clusters.member_offset[c];i<clusters.member_offset[c+1];i++) {
+			node *mynode = &mydag->nodes[clusters.members[i]];
+	
+			for (int j=0;j<NUM_IN_EDGES(mynode);j++) {
+				int s = clusters.cluster_of[IN_EDGE(mynode,j).node_index];
+				if (s == c) continue;
+				if (!weight[s]++) {
+					sources[num_sources++] = s;
+					first_input[s] = IN_EDGE(mynode,j).input_num;
+				}
+			}
+		}
+	
+		for (int k=0;k<num_sources;k++) {
+			int s = sources[k];
+			myedge.id = num_edges++;
+			myedge.source = vertices[s].id;
+			myedge.target = vertices[c].id;
+			myedge.input_num = first_input[s];
+			myedge.weight = weight[s];
+			write_edge(myFile,format,&vertices[s],&vertices[c],&myedge);
+			weight[s] = 0;
+		}
+	}
+	
+	write_footer(myFile,format);
+	
+	free(vertices);
+	free(weight);
+	free(sources);
+	free(first_input);
+	free_clusters(&clusters);
+}
+
+void write_graph_file (node *layers[],const char *filename,graph_format format,int cluster_neurons) {
+	char str[1024];
+	
+	FILE *myFile = fopen(filename,"w+");
+	if (!myFile) {
+		snprintf(str,1024,"ERROR: opening \"%s\" for write",filename);
+		perror(str);
+		exit(1);
+	}
+	char *buffer = (char *)malloc(GRAPH_WRITE_BUFFER);
+	setvbuf(myFile,buffer,_IOFBF,GRAPH_WRITE_BUFFER);
+	
+	export_graph(layers,myFile,format,cluster_neurons);
+	
+	fclose(myFile);
+	free(buffer);
+}
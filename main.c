@@ -21,10 +21,52 @@ int main () {
 	// these is the argument container needed for DAG traversal
 	argstype myargs;
 	
+#ifdef DATATYPE_COST_MODEL
+	// latencies for the datatype, before any DAG is timed
+	apply_cost_model(DATAPATH_TYPE);
+#endif
+	
+#ifdef BENCHMARK_DAG_BUILD
+	// time DAG construction across a range of topologies and exit
+	benchmark_dag_build();
+	return 0;
+#endif
+
+#ifdef BENCHMARK_FORMULATIONS
+	// solve the same DAGs with both ILP formulations and exit
+	benchmark_formulations();
+	return 0;
+#endif
+
+#ifdef DESIGN_SWEEP
+	// evaluate the parameter grid in SWEEP_GRID_FILE and exit
+	design_sweep(SWEEP_GRID_FILE);
+	return 0;
+#endif
+
+#ifdef PARETO_SWEEP
+	// solve the adders x multipliers grid in SWEEP_GRID_FILE concurrently,
+	// print the latency vs. units Pareto front and exit
+	pareto_sweep(SWEEP_GRID_FILE);
+	return 0;
+#endif
+
 	// create DAG for basic 3-layer network
 	logmsg("Converting MLP to DAG...");
 	int layer_sizes[] = MLP_TOPOLOGY;
+#if defined(TEMPLATE_DAG) && defined(PERFORM_SCHEDULING)
+	// the templates are scheduled instead, and the DAG is only expanded from
+	// them if something needs its nodes (see EXPAND_TEMPLATE_DAG)
+	layers=NULL;
+#elif defined(DAG_CACHE)
+	layers=load_network_dag(FORWARD_DAG_CACHE,NUM_LAYERS,layer_sizes,1,0);
+	
+	// the cache is rewritten only if the DAG was built, or its timing was
+	// computed, during this run (-1 means it wasn't loaded at all)
+	int cached_forward_timing = layers[0]->graph->mapping ? layers[0]->graph->timed : -1;
+#else
 	layers=create_basic_network_dag(NUM_LAYERS,layer_sizes,1,0);
+#endif
 	
 	// forecast length--an important parameter
 	int forecast_length=FORECAST_LENGTH;
@@ -32,19 +74,140 @@ int main () {
 	srand(42);
 	
 #ifdef PERFORM_SCHEDULING
+#ifdef TEMPLATE_DAG
+	// the compressed DAG, with one neuron template per layer
+	template_network *net = create_template_network(NUM_LAYERS,layer_sizes,1,0);
+#endif
+	
+#ifdef DATATYPE_COST_MODEL
+	// as many units as the device's budget holds for the datatype
+	int num_adds,num_mults;
+#ifdef TEMPLATE_DAG
+	count_template_operations(net,&num_adds,&num_mults);
+#else
+	count_operations(layers[0]->graph,&num_adds,&num_mults);
+#endif
+	budget_units(num_adds,num_mults,DATAPATH_TYPE,DSP_BUDGET,LUT_BUDGET,&schedule_adders,&schedule_multipliers);
+#endif
+	
+#ifdef DECOMPOSED_SCHEDULING
+	// schedule the forward and the backpropagation DAG window by window,
+	// both at the same time
+	int decompose_sizes[NUM_LAYERS];
+	for (int i=0;i<NUM_LAYERS;i++) decompose_sizes[i] = layer_sizes[NUM_LAYERS-i-1];
+	node **decompose_back=create_basic_network_dag(NUM_LAYERS,decompose_sizes,0,1);
+	
+	decompose_job jobs[2] = {
+		{layers,NUM_LAYERS,"forward",DECOMPOSE_USE_ILP},
+		{decompose_back,NUM_LAYERS,"backward",DECOMPOSE_USE_ILP}
+	};
+	decompose_schedule_jobs(jobs,2);
+	
+	int latency = jobs[0].latency;
+	free_dag(decompose_back[0]->graph);
+	free(decompose_back);
+#else
+#ifdef TEMPLATE_DAG
+	// schedule the compressed DAG
+	schedule_templates(net);
+	
+#if !defined(USE_GLPK_API) || defined(EXPORT_LP_FILE)
+	// calculate potential functional utilization
+	compute_template_utilization(net,&myargs);
+	
+	// generate ILP program to schedule the DAG
+	generate_template_ilp_file(net,"schedule.lp",&myargs);
+#endif
+	
+#ifdef USE_GLPK_API
+	// the in-process solver builds the ILP from the expanded DAG
+	layers=expand_template_network(net,NUM_LAYERS,layer_sizes,1,0);
+#endif
+#else
 	// schedule the DAG
 	// actually, this only computes ASAP and ALAPs for each node
-	schedule(layers,NUM_LAYERS,layer_sizes[0],layer_sizes[NUM_LAYERS-1]);
+	// (which may already have been loaded from the DAG cache)
+	if (!layers[0]->graph->timed) schedule(layers,NUM_LAYERS,layer_sizes[0],layer_sizes[NUM_LAYERS-1]);
+	
+#ifdef DAG_CACHE
+	// cache the windows of the configured slack now: the heuristic schedule
+	// and the adaptive search tighten them below, and windows cached under
+	// another slack would never match the timing hash
+	if (cached_forward_timing != layers[0]->graph->timed) {
+		save_dag(layers,FORWARD_DAG_CACHE,NUM_LAYERS,layer_sizes,1,0);
+		cached_forward_timing = layers[0]->graph->timed;
+	}
+#endif
 	
+#if defined(MODULO_SCHEDULING)
+	// pick the initiation interval, and keep its modulo schedule as the
+	// heuristic schedule
+	int upper_bound = modulo_ii_search(layers,NUM_LAYERS,layer_sizes[0],layer_sizes[NUM_LAYERS-1]);
+#elif defined(HEURISTIC_WARM_START) || defined(HEURISTIC_SCHEDULE_ONLY) || defined(ADAPTIVE_SLACK)
+	// schedule heuristically
+	int upper_bound = heuristic_schedule(layers,NUM_LAYERS,layer_sizes[0],layer_sizes[NUM_LAYERS-1]);
+#endif
+#if (defined(MODULO_SCHEDULING) || defined(HEURISTIC_WARM_START) || defined(HEURISTIC_SCHEDULE_ONLY)) && !defined(ADAPTIVE_SLACK)
+	// then leave the ILP only the windows of schedules that are no longer
+	// (the heuristic schedule stays in the nodes as the solver's MIP start)
+	if (upper_bound >= 0 && upper_bound - layers[NUM_LAYERS]->asap_cycle < schedule_slack)
+		set_slack(layers,NUM_LAYERS,layer_sizes[0],upper_bound - layers[NUM_LAYERS]->asap_cycle);
+#endif
+	
+#if !defined(HEURISTIC_SCHEDULE_ONLY) && !defined(ADAPTIVE_SLACK) && (!defined(USE_GLPK_API) || defined(EXPORT_LP_FILE))
 	// calculate potential functional utilization
 	compute_functional_utilization(layers,NUM_LAYERS,layer_sizes[0],layer_sizes[NUM_LAYERS-1],&myargs);
 		
 	// generate ILP program to schedule the DAG
 	generate_ilp_file (layers,NUM_LAYERS,layer_sizes[0],layer_sizes[NUM_LAYERS-1],"schedule.lp",&myargs);
+#endif
+#endif
 	
 	// solve the schedule
+#if defined(HEURISTIC_SCHEDULE_ONLY) && !defined(TEMPLATE_DAG)
+	int latency = upper_bound;
+#elif defined(ADAPTIVE_SLACK) && !defined(TEMPLATE_DAG)
+	// the ILPs are written and solved with growing windows
+	int latency = solve_adaptive(layers,NUM_LAYERS,layer_sizes[0],layer_sizes[NUM_LAYERS-1],"schedule.lp",upper_bound);
+#elif defined(TEMPLATE_DAG) && !defined(USE_GLPK_API)
+	// the solution stays with the templates
+	int latency = solve_template_schedule(net,"schedule.lp");
+#elif defined(USE_GLPK_API)
+	int latency = solve_schedule_glpk(layers,NUM_LAYERS,layer_sizes[0],layer_sizes[NUM_LAYERS-1]);
+#else
 	int latency = solve_schedule(layers,NUM_LAYERS,layer_sizes[0],layer_sizes[NUM_LAYERS-1],"schedule.lp");
-	logmsg("Schedule minimum latency for %d adders and %d multipliers = %d cycles",NUM_ADDERS,NUM_MULTIPLIERS,latency);
+#endif
+#endif
+	logmsg("Schedule minimum latency for %d adders and %d multipliers = %d cycles",schedule_adders,schedule_multipliers,latency);
+	
+	// register pressure of the schedule
+	int peak_registers;
+	long register_cycles;
+#if defined(TEMPLATE_DAG) && !defined(USE_GLPK_API)
+	template_register_pressure(net,&peak_registers,&register_cycles);
+#else
+	register_pressure(layers[0]->graph,NULL,&peak_registers,&register_cycles);
+#endif
+	logmsg("Schedule register pressure: peak %d registers, %ld register-cycles",peak_registers,register_cycles);
+	
+	if (schedule_ii) {
+		logmsg("Initiation interval %d cycles: %.4f samples per cycle",schedule_ii,1.f/schedule_ii);
+	}
+	
+#if defined(EXPAND_TEMPLATE_DAG) && !defined(USE_GLPK_API)
+	// the binding and the graph files work on the nodes, so the DAG is
+	// expanded with the templates' timing and schedule
+	layers=expand_template_network(net,NUM_LAYERS,layer_sizes,1,0);
+#endif
+	
+#ifdef BIND_SCHEDULE
+	// bind the schedule onto unit instances and registers for the codegen
+	binding *mybinding = bind_schedule(layers[0]->graph,schedule_adders,schedule_multipliers);
+	logmsg("Binding: %d adders, %d multipliers, %d registers, %d mux inputs (widest mux %d inputs)",
+			mybinding->num_adders,mybinding->num_multipliers,mybinding->num_registers,mybinding->mux_inputs,mybinding->max_fan_in);
+	write_binding(mybinding,BINDING_FILE);
+	free_binding(mybinding);
+#endif
 	
 	// compute actual functional utilization and generate report
 	//tabulate_functional_unit_utilization (layers,NUM_LAYERS,layer_sizes[0],layer_sizes[NUM_LAYERS-1]);
@@ -56,11 +219,21 @@ int main () {
 	//tabulate_schedule_by_cycle (layers,NUM_LAYERS,layer_sizes[0],layer_sizes[NUM_LAYERS-1]);
 #endif
 
+#if defined(DAG_CACHE) && !(defined(TEMPLATE_DAG) && defined(PERFORM_SCHEDULING))
+	if (cached_forward_timing != layers[0]->graph->timed) save_dag(layers,FORWARD_DAG_CACHE,NUM_LAYERS,layer_sizes,1,0);
+#endif
+
 #ifdef GENPDFS
 	logmsg("Generating PDF for forward propagation DAG...");
 	gen_dot(layers,"forward_pass.pdf",NUM_LAYERS,layer_sizes[0],layer_sizes[NUM_LAYERS-1]);
 #endif
 
+#ifdef GEN_GRAPH_FILES
+	logmsg("Writing graph files for forward propagation DAG...");
+	write_graph_file(layers,"forward_pass.graphml",GRAPH_GRAPHML,layers[0]->graph->num_nodes > GRAPH_CLUSTER_THRESHOLD);
+	write_graph_file(layers,"forward_pass.gexf",GRAPH_GEXF,layers[0]->graph->num_nodes > GRAPH_CLUSTER_THRESHOLD);
+#endif
+
 #ifdef ONLINE_TRAINING
 	// create a reversed version of the layer size array for calculating gradients
 	// note that this might not work for non-linear activation functions
@@ -71,7 +244,12 @@ int main () {
 	
 	// create another DAG for the backpropagation
 	logmsg("Creating backpropagation DAG...");
+#ifdef DAG_CACHE
+	back_layers=load_network_dag(BACKWARD_DAG_CACHE,NUM_LAYERS,layer_sizes_in_reverse,0,1);
+	if (!back_layers[0]->graph->mapping) save_dag(back_layers,BACKWARD_DAG_CACHE,NUM_LAYERS,layer_sizes_in_reverse,0,1);
+#else
 	back_layers=create_basic_network_dag(NUM_LAYERS,layer_sizes_in_reverse,0,1);
+#endif
 	
 	// this flag is used for HLS C-code generation
 	int gen_backprop=1;
@@ -81,6 +259,11 @@ int main () {
 		logmsg("Generating PDF for backpropagation DAG...");
 		gen_dot(back_layers,"backward_pass.pdf",NUM_LAYERS,layer_sizes_in_reverse[0],layer_sizes_in_reverse[NUM_LAYERS-1]);
 	#endif
+	#ifdef GEN_GRAPH_FILES
+		logmsg("Writing graph files for backpropagation DAG...");
+		write_graph_file(back_layers,"backward_pass.graphml",GRAPH_GRAPHML,back_layers[0]->graph->num_nodes > GRAPH_CLUSTER_THRESHOLD);
+		write_graph_file(back_layers,"backward_pass.gexf",GRAPH_GEXF,back_layers[0]->graph->num_nodes > GRAPH_CLUSTER_THRESHOLD);
+	#endif
 #else
 	// this flag is used for HLS C-code generation
 	int gen_backprop=0;
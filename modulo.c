@@ -0,0 +1,128 @@
+#include "netscheduler.h"
+
+// modulo scheduling: with samples entering the pipeline every II cycles,
+// the operations of consecutive samples that start in cycles c and c+II
+// run at the same time, so every unit is reserved in slot c mod II of a
+// reservation table instead of in cycle c.  the DAG carries no dependencies
+// from one sample to the next (the weights are constants here), so the
+// only lower bound on II is the resource one: each unit is busy for at most
+// II cycles per sample (one per operation, if it's fully pipelined).
+//
+// the search tries II = resource bound, bound+1, ... with an operation
+// driven list scheduler: nodes by ALAP, each placed in the first cycle
+// from its operands' arrival from which a unit is free in every slot it
+// would occupy.  the first II at which every node meets its ALAP (i.e. the
+// latency stays within the slack) is the minimum, as far as the heuristic
+// can tell
+
+// ALAP first, topological position second
+static int compare_keys (const void *a,const void *b) {
+	int64_t x = *(const int64_t *)a;
+	int64_t y = *(const int64_t *)b;
+	
+	return x < y ? -1 : x > y;
+}
+
+// resource bound on the initiation interval
+int resource_mii (dag *mydag,int num_adders,int num_multipliers) {
+	int num_adds=0,num_mults=0;
+	
+	for (int i=0;i<mydag->num_nodes;i++) {
+		if (mydag->nodes[i].type == ADD) num_adds++;
+		if (mydag->nodes[i].type == MULT) num_mults++;
+	}
+	
+	int mii = busy_cycles(num_adds,ADD,num_adders);
+	if (busy_cycles(num_mults,MULT,num_multipliers) > mii) mii = busy_cycles(num_mults,MULT,num_multipliers);
+	
+	return mii ? mii : 1;
+}
+
+// schedule the DAG for initiation interval ii into start[] (see above).
+// returns the start cycle of the last node, or -1 if a node misses its ALAP.
+// the DAG's timing must be computed, and isn't modified
+int modulo_schedule (dag *mydag,int ii,int num_adders,int num_multipliers,int *start) {
+	int n = mydag->num_nodes;
+	node_idx *order = topological_order(mydag);
+	int64_t *keys = (int64_t *)malloc(sizeof(int64_t)*(n ? n : 1));
+	int *add_slots = (int *)calloc(ii,sizeof(int));
+	int *mult_slots = (int *)calloc(ii,sizeof(int));
+	int latency=0;
+	
+	for (int i=0;i<n;i++) keys[i] = ((int64_t)mydag->nodes[order[i]].alap_cycle << 32) | i;
+	qsort(keys,n,sizeof(int64_t),compare_keys);
+	
+	for (int i=0;i<n;i++) {
+		node *mynode = &mydag->nodes[order[keys[i] & 0xffffffff]];
+		int *slots = mynode->type == ADD ? add_slots : mynode->type == MULT ? mult_slots : NULL;
+		int num_units = mynode->type == ADD ? num_adders : num_multipliers;
+		int cycle=0;
+		
+		for (int j=0;j<NUM_IN_EDGES(mynode);j++) {
+			node *pred = IN_NODE(mynode,j);
+			if (start[pred->index] + NODE_LATENCY(pred) > cycle) cycle = start[pred->index] + NODE_LATENCY(pred);
+		}
+		
+		// II consecutive cycles cover every slot once
+		if (slots) {
+			int tries;
+			for (tries=0;tries<ii && !unit_available(slots,mynode->type,ii,cycle,num_units);tries++) cycle++;
+			if (tries == ii) {
+				latency = -1;
+				break;
+			}
+			occupy_unit(slots,mynode->type,ii,cycle,1);
+		}
+		
+		if (cycle > mynode->alap_cycle) {
+			latency = -1;
+			break;
+		}
+		
+		start[mynode->index] = cycle;
+		if (cycle > latency) latency = cycle;
+	}
+	
+	free(keys);
+	free(add_slots);
+	free(mult_slots);
+	
+	return latency;
+}
+
+// find the smallest initiation interval with a modulo schedule inside the
+// windows, and leave it in schedule_ii for the ILP, and the schedule in the
+// nodes' scheduled cycles.  returns the schedule's latency, or -1 (with
+// schedule_ii cleared) if no interval up to the non-overlapping one works.
+// the DAG's timing must be computed
+int modulo_ii_search (node *layers[],int num_layers,int num_inputs,int num_outputs) {
+	dag *mydag = layers[0]->graph;
+	int n = mydag->num_nodes;
+	int *start = (int *)malloc(sizeof(int)*(n ? n : 1));
+	int mii = resource_mii(mydag,schedule_adders,schedule_multipliers);
+	int last_cycle = layers[num_layers]->alap_cycle;
+	int latency=-1;
+	
+	schedule_ii = 0;
+	
+	// beyond the last cycle, nothing folds any more
+	for (int ii=mii;ii<=last_cycle+1;ii++) {
+		latency = modulo_schedule(mydag,ii,schedule_adders,schedule_multipliers,start);
+		
+		if (latency >= 0) {
+			schedule_ii = ii;
+			for (int i=0;i<n;i++) mydag->nodes[i].scheduled_cycle = start[i];
+			break;
+		}
+	}
+	
+	if (schedule_ii) {
+		logmsg("Minimum initiation interval %d cycles (resource bound %d), latency %d cycles",schedule_ii,mii,latency);
+	} else {
+		logmsg("No modulo schedule within %d cycles (resource bound %d)",last_cycle,mii);
+	}
+	
+	free(start);
+	
+	return latency;
+}
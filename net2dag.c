@@ -1,22 +1,49 @@
 #include "netscheduler.h"
 
-int add_layer (node **layers,int layer_num,int id,int prev_layer_size,int new_layer_size,layer_type type,int inc_bias,int inc_delta_multiplier) {
+void count_network_nodes (int num_layers,int *layer_sizes,int inc_bias,int inc_delta_multiplier,int *num_nodes,int *num_edges) {
+	// input layer
+	*num_nodes = layer_sizes[0];
+	*num_edges = 0;
+	
+	// each neuron has one multiplier per input, a binary adder tree, and
+	// optionally a bias adder and a delta multiplier
+	for (int i=1;i<num_layers;i++) {
+		int prev_layer_size = layer_sizes[i-1];
+		int per_neuron = prev_layer_size + (prev_layer_size-1) + inc_bias + inc_delta_multiplier;
+		
+		*num_nodes += layer_sizes[i] * per_neuron;
+		*num_edges += layer_sizes[i] * (prev_layer_size + 2*(prev_layer_size-1) + inc_bias + inc_delta_multiplier);
+	}
+	
+	// final output node
+	*num_nodes += 1;
+	*num_edges += layer_sizes[num_layers-1];
+}
+
+int add_layer (dag *mydag,node **layers,int layer_num,int id,int prev_layer_size,int new_layer_size,layer_type type,int inc_bias,int inc_delta_multiplier) {
 	node *adder,*output=0,*prev_multiplier,*prev_adder,*multiplier,*newnode=0,*prev_layer_adder;
+	
+	// indexable vector of this layer's output nodes, so the next layer
+	// can find its predecessors without walking the list
+	node_idx *layer_vector = mydag->layer_nodes[layer_num] = (node_idx *)malloc(sizeof(node_idx)*new_layer_size);
+	node_idx *prev_layer_vector = layer_num ? mydag->layer_nodes[layer_num-1] : NULL;
+	mydag->layer_size[layer_num] = new_layer_size;
 
 	if (type == INPUT_LAYER) {
 		// create input layer
 		for (int i=0;i<new_layer_size;i++) {
 			if (newnode) {
-				newnode->next = create_node(INPUT,id++);
+				newnode->next = create_node(mydag,INPUT,id++);
 				newnode->next->prev = newnode;
 				newnode = newnode->next;
 				newnode->neuron = i;
 			} else {
 				// first input
-				newnode = layers[0] = create_node(INPUT,id++);
+				newnode = layers[0] = create_node(mydag,INPUT,id++);
 				newnode->neuron = i;
 			}
 			newnode->layer=layer_num;
+			layer_vector[i] = newnode->index;
 		}
 		// complete the cycle
 		newnode->next = 0;
@@ -31,7 +58,7 @@ int add_layer (node **layers,int layer_num,int id,int prev_layer_size,int new_la
 				prev_multiplier = multiplier;
 
 				// create new multiplier node and initialize
-				multiplier = create_node (MULT,id++);
+				multiplier = create_node (mydag,MULT,id++);
 				multiplier->layer = layer_num;
 				multiplier->neuron = i;
 				multiplier->input_number = j; // not used?
@@ -44,10 +71,7 @@ int add_layer (node **layers,int layer_num,int id,int prev_layer_size,int new_la
 
 				// link it back to the previous layer
 				// find its corresponding input, which is number j
-				node *predecessor = layers[layer_num-1];
-
-				// walk to node j
-				for (int k=0;k<j;k++) predecessor = predecessor->next;
+				node *predecessor = &mydag->nodes[prev_layer_vector[j]];
 				
 				// connect multiplier back to output of previous layer
 				connect_nodes (predecessor,multiplier,j);
@@ -67,7 +91,7 @@ int add_layer (node **layers,int layer_num,int id,int prev_layer_size,int new_la
 						}
 						// instance new adder
 						node *prev_adder = adder;
-						adder = create_node (ADD,id++);
+						adder = create_node (mydag,ADD,id++);
 						adder->neuron = i;
 						adder->layer = layer_num;
 						if (k>0) {
@@ -101,7 +125,7 @@ int add_layer (node **layers,int layer_num,int id,int prev_layer_size,int new_la
 			// we don't need the bias node for back-propagation
 			if (inc_bias) {
 				// add the bias adder
-				node *bias_adder = create_node (ADDBIAS,id++);
+				node *bias_adder = create_node (mydag,ADDBIAS,id++);
 				bias_adder->layer = layer_num;
 				bias_adder->neuron = i;
 				bias_adder->input_number = 0;
@@ -114,7 +138,7 @@ int add_layer (node **layers,int layer_num,int id,int prev_layer_size,int new_la
 			// ...we do, however, need to multiply each delta by the previous output
  			if (inc_delta_multiplier) {
 				// add the delta multiplier
-				node *delta_multiplier = create_node (MULT,id++);
+				node *delta_multiplier = create_node (mydag,MULT,id++);
 				delta_multiplier->layer = layer_num;
 				delta_multiplier->neuron = i;
 				delta_multiplier->input_number = 0;
@@ -127,25 +151,19 @@ int add_layer (node **layers,int layer_num,int id,int prev_layer_size,int new_la
 			
 			// mark this as a "final" adder (er, node)
 			adder->final_adder=1;
+			layer_vector[i] = adder->index;
 			
 			// connect the final adder output to the layer 1 list
+			adder->next = 0;
 			if (i==0) {
 				// first neuron
 				layers[layer_num] = adder;
+				adder->prev = 0;
 			} else {
 				// not the first neuron
-				node *mynode = layers[layer_num];
-				while (mynode->next) mynode=mynode->next;
+				node *mynode = &mydag->nodes[layer_vector[i-1]];
 				mynode->next = adder;
-				mynode->next->prev = mynode;
-				
-				// complete the ring
-				if (i==new_layer_size-1) {
-					/* mynode->next->next=layers[layer_num];
-					layers[layer_num]->prev = mynode; */
-					mynode->next->next=0;
-					layers[layer_num]->prev = 0;
-				}
+				adder->prev = mynode;
 			}
 			
 		}
@@ -159,23 +177,21 @@ int add_layer (node **layers,int layer_num,int id,int prev_layer_size,int new_la
 				prev_multiplier = multiplier;
 
 				// create new multiplier node and initialize
-				multiplier = create_node (MULT,id++);
+				multiplier = create_node (mydag,MULT,id++);
 				multiplier->layer = layer_num;
 				multiplier->neuron = i;
 				multiplier->input_number = j;
 
 				// link it back to the previous layer
 				// find its corresponding input, which is number j
-				node *predecessor = layers[layer_num-1];
+				node *predecessor = &mydag->nodes[prev_layer_vector[j]];
 
-				// walk to node j
-				for (int k=0;k<j;k++) predecessor = predecessor->next;
 				// connect multiplier back to output of previous layer
 				connect_nodes (predecessor,multiplier,j);
 
 				if (j>0) { // don't do anything after creating the first multiplier
 					prev_adder = adder;
-					adder = create_node (ADD,id++);
+					adder = create_node (mydag,ADD,id++);
 					adder->neuron = i;
 
 					if (j==1) {
@@ -192,13 +208,13 @@ int add_layer (node **layers,int layer_num,int id,int prev_layer_size,int new_la
 
 			// mark this as a "final" adder
 			adder->final_adder=1;
+			layer_vector[i] = adder->index;
 
 			// connect the final adder output to the layer 1 list
 			if (i==0) {
 				layers[layer_num] = adder;
 			} else {
-				node *mynode = layers[layer_num];
-				while (mynode->next) mynode=mynode->next;
+				node *mynode = &mydag->nodes[layer_vector[i-1]];
 				mynode->next = adder;
 				mynode->next->prev = mynode;
 				
@@ -215,9 +231,10 @@ int add_layer (node **layers,int layer_num,int id,int prev_layer_size,int new_la
 		
 			// link to previously-spawned node, if exists, and spawn a new node
 			node *prev_output = output;
-			output = create_node (OUTPUT,id++);
+			output = create_node (mydag,OUTPUT,id++);
 			output->layer = layer_num;
 			output->neuron = i;
+			layer_vector[i] = output->index;
 			if (layers[layer_num]==0) {
 				// if first node, point to it in layer table
 				layers[layer_num] = output;
@@ -229,11 +246,9 @@ int add_layer (node **layers,int layer_num,int id,int prev_layer_size,int new_la
 				// add wrap-around link, which will be overwritten if this isn't the last node spawned
 				output->next = layers[layer_num];
 			}
-			// walk across previous layer 
-			node *mynode = layers[layer_num-1];
+			// connect across previous layer
 			for (int j=0;j<prev_layer_size;j++) { // for each input from the previous layer, add an output
-				connect_nodes(mynode,output,j);
-				mynode = mynode->next;
+				connect_nodes(&mydag->nodes[prev_layer_vector[j]],output,j);
 			}
 		}
 	}
@@ -243,8 +258,7 @@ int add_layer (node **layers,int layer_num,int id,int prev_layer_size,int new_la
 
 // create DAG for a basic 3,4,1 MLP
 node **create_basic_network_dag (int num_layers,int *layer_sizes,int inc_bias,int inc_delta_multiplier) {
-	node *newnode=NULL,
-		 **layers;
+	node **layers;
 
 	int i,id=0,prev_layer_size=-1;
 
@@ -252,19 +266,59 @@ node **create_basic_network_dag (int num_layers,int *layer_sizes,int inc_bias,in
 	// I don't remember why this is needed
 	layers=(node **)malloc((num_layers+1)*sizeof(node*));
 	
+	// size the node arena for the whole network up front
+	int max_nodes,max_edges;
+	count_network_nodes(num_layers,layer_sizes,inc_bias,inc_delta_multiplier,&max_nodes,&max_edges);
+	dag *mydag = create_dag(max_nodes,max_edges);
+	
+	// one node vector per layer, plus the final output
+	mydag->num_layers = num_layers+1;
+	mydag->layer_size = (int *)malloc(sizeof(int)*(num_layers+1));
+	mydag->layer_nodes = (node_idx **)malloc(sizeof(node_idx *)*(num_layers+1));
+	
 	for (i=0;i<num_layers;i++) {
 		layers[i]=0;
 		layer_type type = i==0 ? INPUT_LAYER :
 						  i==num_layers ? OUTPUT_LAYER :
 						  NEURON_BINARY_ADD_LAYER;
 						  
-		id=add_layer(layers,i,id,prev_layer_size,layer_sizes[i],type,inc_bias,inc_delta_multiplier);
+		id=add_layer(mydag,layers,i,id,prev_layer_size,layer_sizes[i],type,inc_bias,inc_delta_multiplier);
 		prev_layer_size=layer_sizes[i];
 	}
 	
 	layers[i]=0;
-	id=add_layer(layers,i,id,prev_layer_size,1,OUTPUT_LAYER,inc_bias,inc_delta_multiplier);
+	id=add_layer(mydag,layers,i,id,prev_layer_size,1,OUTPUT_LAYER,inc_bias,inc_delta_multiplier);
+	
+	build_csr(mydag);
 
 	return layers;
 }
 
+
+void benchmark_dag_build (void) {
+	int topologies[][3] = {{50,10,1},{100,20,1},{500,50,1},{1000,50,1},{2000,100,1},{5000,100,1},{10000,100,1}};
+	int num_topologies = sizeof(topologies)/sizeof(topologies[0]);
+	
+	printf ("DAG build time\n"
+	        "--------------\n");
+	printf ("%20s%12s%12s%12s%12s\n","topology","nodes","edges","ms","ns/edge");
+	
+	for (int i=0;i<num_topologies;i++) {
+		struct timespec start,end;
+		char str[1024];
+		
+		clock_gettime(CLOCK_MONOTONIC,&start);
+		node **layers = create_basic_network_dag(3,topologies[i],1,0);
+		clock_gettime(CLOCK_MONOTONIC,&end);
+		
+		dag *mydag = layers[0]->graph;
+		double ms = (end.tv_sec - start.tv_sec)*1e3 + (end.tv_nsec - start.tv_nsec)*1e-6;
+		
+		snprintf(str,1024,"{%d,%d,%d}",topologies[i][0],topologies[i][1],topologies[i][2]);
+		printf ("%20s%12d%12d%12.2f%12.1f\n",str,mydag->num_nodes,mydag->num_edges,ms,ms*1e6/mydag->num_edges);
+		
+		free_dag(mydag);
+		free(layers);
+	}
+}
+
@@ -4,6 +4,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 #include "trainer.h"
 
@@ -12,9 +20,24 @@
 // relates to generation of DAGs
 #define BINARY_ADDER
 
+// schedule a compressed DAG (one neuron template per layer) instead of
+// the fully materialized one
+//#define TEMPLATE_DAG
+
+// keep built (and scheduled) DAGs in binary files that are mapped on later
+// runs instead of being rebuilt
+//#define DAG_CACHE
+#define FORWARD_DAG_CACHE	"forward.dag"
+#define BACKWARD_DAG_CACHE	"backward.dag"
+
 #define LAYER1_MEMORY_BANKS		1024
 
 // solver
+// build and solve the ILP in-process through the GLPK library (link with
+// -lglpk) instead of writing it out and running a solver on the file
+//#define USE_GLPK_API
+// when solving in-process, still write the ILP to "schedule.lp"
+//#define EXPORT_LP_FILE
 #define	USE_GUROBI
 #define GUROBI_PATH		"LD_LIBRARY_PATH=\"/home/csce611/gurobi911/linux64/lib\" /home/csce611/gurobi911/linux64/bin"
 //#define GUROBI_PATH	"/usr/sbin"
@@ -31,6 +54,55 @@
 // type of schedule sought
 //#define VECTORIZE
 
+// ILP model written by generate_ilp_file() (can be changed at run time
+// through schedule_formulation): ILP_TIME_INDEXED has one binary per node
+// per cycle of its window, ILP_START_TIME one integer start time per node,
+// plus binaries only for the nodes that may meet an oversubscribed cycle
+#define ILP_FORMULATION		ILP_TIME_INDEXED
+
+// register pressure term of the ILP objective (can be changed at run time
+// through schedule_registers): REGISTERS_SUM adds the summed lifetimes of
+// all values (from the producer's finish to the last consumer's start),
+// REGISTERS_PEAK the most values live in any cycle (time-indexed
+// formulation only).  a cycle of latency weighs REGISTER_LATENCY_WEIGHT
+// registers, 0 leaves the latency to the windows.  heuristic_schedule()
+// then also moves nodes within their slack to shorten the lifetimes
+#define REGISTER_OBJECTIVE		REGISTERS_NONE
+#define REGISTER_LATENCY_WEIGHT	1000
+
+// order the start times of interchangeable neurons in the ILP, so the
+// solver doesn't branch through mirror images of the same schedule
+//#define NEURON_SYMMETRY_BREAKING
+
+// schedule layer by layer (see decompose.c): windows of DECOMPOSE_WINDOW
+// layers, of which the first DECOMPOSE_STEP are kept before moving on.  the
+// windows are list scheduled, and then solved as ILPs if DECOMPOSE_USE_ILP
+// is set.  the forward and backpropagation DAGs are scheduled concurrently
+//#define DECOMPOSED_SCHEDULING
+#define DECOMPOSE_WINDOW	2
+#define DECOMPOSE_STEP		1
+#define DECOMPOSE_USE_ILP	0
+
+// schedule heuristically before the ILP is written: the heuristic latency
+// bounds every node's ALAP, and the schedule is the solver's MIP start.
+// with HEURISTIC_SCHEDULE_ONLY, the ILP isn't solved at all
+#define HEURISTIC_WARM_START
+//#define HEURISTIC_SCHEDULE_ONLY
+
+// instead of the fixed SLACK, start the output's deadline at the latency's
+// lower bound and widen it only while the ILP is infeasible, so the solver
+// works on the smallest windows that hold the optimum
+//#define ADAPTIVE_SLACK
+
+// search the smallest initiation interval at which a modulo schedule meets
+// the latency windows (see modulo.c), then solve the ILP at that interval
+//#define MODULO_SCHEDULING
+
+// bind the final schedule onto unit instances and registers (see
+// binding.c), and write the binding to BINDING_FILE for the codegen
+//#define BIND_SCHEDULE
+#define BINDING_FILE		"binding.csv"
+
 // debugging statements to be generated in network.cpp and in trainer_layers
 //#define	GEN_NETWORK_DEBUG
 
@@ -41,6 +113,10 @@
 #define	DEBUG_TARGET		stderr
 
 // which steps to perform
+//#define BENCHMARK_DAG_BUILD
+//#define DESIGN_SWEEP
+//#define PARETO_SWEEP
+//#define BENCHMARK_FORMULATIONS
 //#define PERFORM_SCHEDULING
 #define GEN_HLS_CODE
 #define GENERATE_TESTBENCH
@@ -67,12 +143,29 @@
 #define LEARNING_RATE			0.1f
 #define	INITIAL_WEIGHT_SCALER	1.f
 
-// memory allocation for BFS
-#define QUEUESIZE			(1024*1024)
-
 // debugging PDFs
 //#define	GENPDFS
 
+// GraphML/GEXF dumps of the DAGs (for yEd or Gephi)
+//#define GEN_GRAPH_FILES
+
+// graph exports of DAGs with more nodes than this collapse each neuron
+// into one summary node
+#define GRAPH_CLUSTER_THRESHOLD	2000
+#define GRAPH_WRITE_BUFFER		(4<<20)
+
+// threads used for ASAP/ALAP analysis (0 means one per online core), and
+// the narrowest topological level that is split across them
+#define TIMING_THREADS		0
+#define TIMING_LEVEL_GRAIN	4096
+
+// parameter grid for DESIGN_SWEEP, and its threads (0 means one per online core)
+#define SWEEP_GRID_FILE		"sweep.txt"
+#define SWEEP_THREADS		0
+
+// concurrent solver instances for PARETO_SWEEP (0 means one per online core)
+#define PARETO_THREADS		0
+
 // physical resource constraints (for scheduling)
 #define NUM_ADDERS			1000
 #define NUM_MULTIPLIERS		1000
@@ -90,15 +183,101 @@
 // maximum iteration interval (actually the variation, so 0 means all inputs are consumed immediately)
 #define MAX_II				0
 
+// initiation interval at which consecutive samples enter the pipeline.  the
+// ILP's resource constraints fold cycle c onto slot c mod II, so that they
+// hold in steady state, with samples overlapping.  0 means samples don't
+// overlap (one resource constraint per cycle)
+#define INITIATION_INTERVAL	0
+
 // functional unit latencies
 #define LATENCY_MULTIPLIER	1
 #define LATENCY_ADDER		3
 #define LATENCY_INPUT		1
 #define LATENCY_OUTPUT		0
 
+// functional unit occupancy: the cycles a unit stays busy with one operation
+// (its initiation interval), 1 for a fully pipelined unit and its latency
+// for one that isn't.  can be changed at run time through node_occupancy[]
+#define OCCUPANCY_MULTIPLIER	1
+#define OCCUPANCY_ADDER			1
+
+// chain dependent operations within a clock cycle (see chaining.c): an
+// operation whose combinational delay fits in CLOCK_PERIOD hands its result
+// to its successors in its own cycle, as long as the delays along the chain
+// add up to no more than the period.  the delays are in ns, as in the
+// m_delay attributes of a Vitis .aemf file (schedextract --delays prints
+// them), and the latencies of the multiplier and adder become the cycles
+// their delays span.  can be changed at run time through node_delay[]
+//#define CHAIN_OPERATIONS
+#define CLOCK_PERIOD			5.0
+#define DELAY_MULTIPLIER		3.4
+#define DELAY_ADDER				1.2
+
+// derive the adder's and multiplier's latency and delay from the datatype
+// (DATATYPE_BASE, or DATATYPE if that's undefined) through the operator
+// cost model (see costmodel.c), and schedule on as many units as fit in the
+// device's DSP and LUT budget, instead of NUM_ADDERS and NUM_MULTIPLIERS
+//#define DATATYPE_COST_MODEL
+#define DSP_BUDGET				220
+#define LUT_BUDGET				53200
+
 // Don't change anything below this line unless you intend to modify
 // the code behavior
 
+#ifdef USE_GLPK_API
+#include <glpk.h>
+#endif
+
+#if defined(USE_GLPK_API) && defined(VECTORIZE)
+#error "the vector unit constraints are only emitted to the LP file, undefine USE_GLPK_API"
+#endif
+
+#if defined(MODULO_SCHEDULING) && defined(TEMPLATE_DAG)
+#error "the template ILP has no modulo resource constraints, undefine TEMPLATE_DAG"
+#endif
+
+#if defined(NEURON_SYMMETRY_BREAKING) && defined(TEMPLATE_DAG)
+#error "the template ILP has no symmetry breaking constraints, undefine TEMPLATE_DAG"
+#endif
+
+#if defined(VECTORIZE) && defined(TEMPLATE_DAG)
+#error "the template ILP has no vector unit constraints, undefine TEMPLATE_DAG"
+#endif
+
+#if defined(DECOMPOSED_SCHEDULING) && defined(TEMPLATE_DAG)
+#error "the decomposed scheduler works on the full DAG, undefine TEMPLATE_DAG"
+#endif
+
+// the templates are scheduled without the full DAG, which is only expanded
+// from them for what works on its nodes
+#if defined(TEMPLATE_DAG) && defined(PERFORM_SCHEDULING) && \
+	(defined(USE_GLPK_API) || defined(BIND_SCHEDULE) || defined(GENPDFS) || defined(GEN_GRAPH_FILES))
+#define EXPAND_TEMPLATE_DAG
+#endif
+
+// the type the datapath computes in
+#ifdef DATATYPE_BASE
+#define DATAPATH_TYPE		DATATYPE_BASE
+#else
+#define DATAPATH_TYPE		DATATYPE
+#endif
+
+#if defined(CHAIN_OPERATIONS) && defined(TEMPLATE_DAG)
+#error "the template ILP has no chained operations, undefine TEMPLATE_DAG"
+#endif
+
+// resource constraint slot of a cycle, and number of slots up to a cycle,
+// under the initiation interval
+#define RESOURCE_SLOT(cycle)		(schedule_ii ? (cycle) % schedule_ii : (cycle))
+#define RESOURCE_SLOTS(last_cycle)	(schedule_ii && schedule_ii <= (last_cycle) ? schedule_ii : (last_cycle)+1)
+
+// an operation keeps its unit busy for OCCUPANCY() cycles from its start.
+// under an initiation interval ii, these fold onto the OCCUPIED_SLOTS()
+// slots from the start's, the k-th of which it holds SLOT_WEIGHT() times
+#define OCCUPANCY(type)				(node_occupancy[type])
+#define OCCUPIED_SLOTS(type,ii)		((ii) && (ii) < OCCUPANCY(type) ? (ii) : OCCUPANCY(type))
+#define SLOT_WEIGHT(type,ii,k)		((ii) ? (OCCUPANCY(type)-(k)+(ii)-1)/(ii) : 1)
+
 #define logmsg(msg,...)		if (DEBUG_FLAG) {\
 								char __str[1024];\
 								snprintf(__str,1024,msg,##__VA_ARGS__);\
@@ -120,15 +299,32 @@
 							t==ADDBIAS ? "node" : \
 							"unknown"
 							
-#define LATENCY(node)		node == MULT ? LATENCY_MULTIPLIER : \
-							node == ADD ? LATENCY_ADDER : \
-							node == INPUT ? LATENCY_INPUT : \
-							node == OUTPUT ? LATENCY_OUTPUT : \
-							node == ADDBIAS ? LATENCY_ADDER : \
-							0
+// functional unit latencies can be changed at run time (see set_latency()),
+// so LATENCY() reads the current latency model
+#define LATENCY(node)		(node_latency[node])
+
+// cycles a combinational delay spans (rounded up), and the latency from a
+// node to its successors, which is 0 if it's chained into them
+#define DELAY_CYCLES(delay)	((int)((delay)/CLOCK_PERIOD) + ((delay) > (int)((delay)/CLOCK_PERIOD)*CLOCK_PERIOD))
+#define NODE_LATENCY(n)		((n)->chained ? 0 : LATENCY((n)->type))
 
 #define max(a,b) a > b ? a : b;
 
+// CSR adjacency accessors (only valid after build_csr())
+#define NUM_IN_EDGES(n)		((int)((n)->graph->in_offset[(n)->index+1] - (n)->graph->in_offset[(n)->index]))
+#define IN_EDGE(n,i)		((n)->graph->in_edge_list[(n)->graph->in_offset[(n)->index]+(i)])
+#define IN_NODE(n,i)		(&(n)->graph->nodes[IN_EDGE(n,i).node_index])
+#define NUM_OUT_EDGES(n)	((int)((n)->graph->out_offset[(n)->index+1] - (n)->graph->out_offset[(n)->index]))
+#define OUT_EDGE(n,i)		((n)->graph->out_edge_list[(n)->graph->out_offset[(n)->index]+(i)])
+#define OUT_NODE(n,i)		(&(n)->graph->nodes[OUT_EDGE(n,i).node_index])
+
+// visitation marks (see clear_flags())
+#define VISITED(n)			((n)->visit_epoch == (n)->graph->epoch)
+#define MARK_VISITED(n)		((n)->visit_epoch = (n)->graph->epoch)
+
+// per-layer node lookup
+#define LAYER_NODE(g,l,i)	(&(g)->nodes[(g)->layer_nodes[l][i]])
+
 // type for a node type
 typedef enum {INPUT,MULT,ADD,OUTPUT,ADDBIAS} node_type;
 
@@ -137,37 +333,131 @@ typedef enum {INPUT_LAYER,NEURON_LAYER,NEURON_BINARY_ADD_LAYER,OUTPUT_LAYER} lay
 
 struct node;
 struct edge;
+struct dag;
+
+// nodes refer to each other by their position in the DAG's node arena
+typedef uint32_t node_idx;
+#define NO_NODE		((node_idx)-1)
 
 // type for a DFG node
 struct node {
 	int id;
+	node_idx index;
+	struct dag *graph;
 	int asap_cycle;
 	int alap_cycle;
 	node_type type;
-	edge *out_edges;
-	edge *in_edges;
 	node *next;
 	node *prev;
-	int flag;
+	unsigned int visit_epoch;
 	int scheduled_cycle;
 	int layer;
 	int input_number;
 	int neuron;
 	int final_adder;
 	int delta_multiplier;
+	int chained;
 };
 
 struct register_table {
 	int *register_usage_by_cycle;
 };
 
-// type for an edge
+// type for an edge (one entry of a CSR adjacency row)
 struct edge {
-	node *edge;
+	node_idx node_index;
 	int input_num;
-	struct edge *next;
 };
 
+// type for the DAG storage: all nodes are allocated from one contiguous
+// arena, and the in/out adjacency is kept in compressed sparse row form
+struct dag {
+	// node arena (fixed capacity, so node pointers stay valid)
+	node *nodes;
+	int num_nodes;
+	int max_nodes;
+
+	// edges in insertion order, used to (re)build the CSR rows
+	node_idx *edge_pred;
+	node_idx *edge_succ;
+	int *edge_input_num;
+	int num_edges;
+	int max_edges;
+
+	// CSR adjacency, row i of node i is [offset[i],offset[i+1])
+	int csr_valid;
+	node_idx *in_offset;
+	edge *in_edge_list;
+	node_idx *out_offset;
+	edge *out_edge_list;
+
+	// a node is marked visited when its visit_epoch equals the DAG's
+	// epoch, so clearing all marks is a single increment
+	unsigned int epoch;
+
+	// cached topological (Kahn) order, valid only when topo_valid is set.
+	// the order is grouped by level: level l is [level_offset[l],level_offset[l+1])
+	// and every node's predecessors are in earlier levels
+	int topo_valid;
+	node_idx *topo_order;
+	int num_levels;
+	node_idx *level_offset;
+	int *node_level;
+
+	// dense table of node indices by node id (NO_NODE for unused ids), so
+	// solver output can be applied without searching the DAG
+	node_idx *id_index;
+	int id_index_size;
+
+	// per-layer node vectors, entry i of layer l is the output node of
+	// neuron i (or input i)
+	int num_layers;
+	int *layer_size;
+	node_idx **layer_nodes;
+
+	// set once the ASAP/ALAP windows have been computed
+	int timed;
+
+	// set when the DAG was loaded from a cache file (see load_dag()), in
+	// which case everything but the nodes lives in the file mapping
+	void *mapping;
+	size_t mapping_size;
+};
+
+// type for one layer of a compressed DAG: a single neuron's subgraph,
+// replicated once per neuron of the layer.  the first fan_in nodes of the
+// template are ports standing for the outputs of the previous layer
+struct template_layer {
+	layer_type type;
+	int replication;
+	int fan_in;
+	int neuron_size;
+	int base_id;
+	node_idx final_index;
+	dag *body;
+
+	// timing, relative to the ports being ready (asap) and to the
+	// neuron's final node (alap)
+	int start_cycle;
+	int *rel_asap;
+	int *rel_alap;
+	int *port_deadline;
+	int *neuron_alap;
+};
+
+// type for a compressed DAG
+struct template_network {
+	int num_layers;
+	int num_nodes;
+	struct template_layer *layers;
+	int *scheduled_cycle;	// per instance id, once solved
+};
+
+// template instance accessors (k is a template node index, i a neuron)
+#define TEMPLATE_ID(t,i,k)		((t)->base_id + (i)*(t)->neuron_size + (int)(k) - (t)->fan_in)
+#define TEMPLATE_ASAP(t,k)		((t)->start_cycle + (t)->rel_asap[k])
+#define TEMPLATE_ALAP(t,i,k)	((t)->neuron_alap[i] + (t)->rel_alap[k])
+
 // type for traversal function
 struct argstype {
 	struct node *node;
@@ -199,18 +489,105 @@ typedef struct {
 	int found;
 } func_cycle;
 
+// type for graph export format
+typedef enum {
+	GRAPH_DOT,GRAPH_GRAPHML,GRAPH_GEXF
+} graph_format;
+
+// type for ILP formulation
+typedef enum {
+	ILP_TIME_INDEXED,ILP_START_TIME
+} ilp_formulation;
+
+// type for the register pressure objective
+typedef enum {
+	REGISTERS_NONE,REGISTERS_SUM,REGISTERS_PEAK
+} register_objective;
+
+// type for how a solver run ended: SOLVER_INFEASIBLE only if the solver
+// proved there is no schedule, SOLVER_UNSOLVED if it failed or stopped
+// without an answer
+typedef enum {
+	SOLVER_OPTIMAL,SOLVER_FEASIBLE,SOLVER_INFEASIBLE,SOLVER_UNSOLVED
+} solver_status;
+
+// results of solve_schedule() and solve_schedule_glpk() that aren't a latency
+#define SCHEDULE_INFEASIBLE	-1
+#define SCHEDULE_UNSOLVED	-2
+
+// type for one DAG scheduled by decompose_schedule()
+typedef struct {
+	node **layers;
+	int num_layers;
+	const char *prefix;
+	int use_ilp;
+	
+	// results
+	int latency;
+	int lower_bound;
+	double ms;
+	int num_windows;
+	int optimal_windows;	// windows the ILP solved to optimality
+} decompose_job;
+
+// type for a schedule's binding (see bind_schedule())
+typedef struct {
+	dag *mydag;
+	
+	// instances used, and registers
+	int num_adders;
+	int num_multipliers;
+	int num_registers;
+	
+	// per node: instance of its unit and register of its value (-1 for
+	// none), and per in-edge (indexed like the CSR rows) the operand's
+	// source, one operand port each
+	int *unit;
+	int *reg;
+	int *source;
+	
+	// inputs of all muxes with more than one, and the widest one
+	int mux_inputs;
+	int max_fan_in;
+} binding;
+
+// type for one entry of the operator cost model: an implementation of an
+// ADD or MULT for fixed point (or integer) or floating point data of up to
+// max_width bits.  a unit instance costs dsps DSPs and luts LUTs, and
+// carries out packing operations at once
+typedef struct {
+	node_type type;
+	int floating;
+	int max_width;
+	
+	// pipeline cycles (0 for a combinational operator), and combinational
+	// delay in ns
+	int latency;
+	double delay;
+	
+	int dsps;
+	int luts;
+	int packing;
+} operator_cost;
+
 // type for traversal order
 typedef enum {
 	FROM_START,FROM_END
 } travordertype;
 
 // DAG ops
+dag *create_dag (int max_nodes,int max_edges);
+void free_dag (dag *mydag);
+void build_csr (dag *mydag);
+node_idx *topological_order (dag *mydag);
 void connect_nodes (node *pred,node *succ,int input_num);
-node *create_node(node_type type,int id);
+node *create_node(dag *mydag,node_type type,int id);
+void index_node_id (dag *mydag,node *mynode);
+node *node_by_id (dag *mydag,int id);
+void apply_solution (dag *mydag,const int *ids,const int *cycles,int count);
 void gen_dot (node *layers[],char *filename,int num_layers,int num_inputs,int num_outputs);
-void node2dot (node *mynode,void *args);
 void traverse_dag (node *layers[],int num_layers,int num_inputs,int num_outputs,void *args,void (nodefunc)(node *,void *),travordertype travorder);
-void clear_flags (node *mynode,void *args);
+void clear_flags (dag *mydag);
 void gen_c_code (node **layers,
 						node **back_layers,
 						int num_layers,
@@ -233,17 +610,97 @@ void gen_c_code_loop_version (node **layers,
 
 void compute_functional_utilization(node **layers,int num_layers,int num_inputs,int num_outputs,argstype *myargs);
 void inc_functional_utilization (node *mynode,void *args);
+void count_operations (dag *mydag,int *num_adds,int *num_mults);
 void generate_hls_wrapper_code(const char *filename,node **layers);
 
+// DAG cache
+void save_dag (node **layers,const char *filename,int num_layers,int *layer_sizes,int inc_bias,int inc_delta_multiplier);
+node **load_dag (const char *filename,int num_layers,int *layer_sizes,int inc_bias,int inc_delta_multiplier);
+node **load_network_dag (const char *filename,int num_layers,int *layer_sizes,int inc_bias,int inc_delta_multiplier);
+void detach_dag (dag *mydag);
+
+// layer decomposition
+void decompose_schedule (decompose_job *job);
+void decompose_schedule_jobs (decompose_job *jobs,int num_jobs);
+
+// register pressure
+void register_pressure (dag *mydag,const int *start,int *peak,long *sum);
+long reduce_register_pressure (dag *mydag,int num_adders,int num_multipliers,int *start);
+
+// binding
+binding *bind_schedule (dag *mydag,int num_adders,int num_multipliers);
+void write_binding (binding *mybinding,const char *filename);
+void free_binding (binding *mybinding);
+
+// operation chaining
+extern double node_delay[];
+int chain_operations (dag *mydag);
+
+// operator cost model
+const operator_cost *find_operator_cost (node_type type,const char *datatype);
+void apply_cost_model (const char *datatype);
+void budget_units (int num_adds,int num_mults,const char *datatype,int dsp_budget,int lut_budget,int *num_adders,int *num_multipliers);
+
+// modulo scheduling
+int resource_mii (dag *mydag,int num_adders,int num_multipliers);
+int modulo_schedule (dag *mydag,int ii,int num_adders,int num_multipliers,int *start);
+int modulo_ii_search (node *layers[],int num_layers,int num_inputs,int num_outputs);
+
+// neuron symmetry
+int neuron_symmetry_pairs (dag *mydag,node_idx **pairs);
+
+// graph export
+void export_graph (node *layers[],FILE *myFile,graph_format format,int cluster_neurons);
+void write_graph_file (node *layers[],const char *filename,graph_format format,int cluster_neurons);
+
 // net to DAG routines
-int add_layer (node **layers,int layer_num,int id,int prev_layer_size,int new_layer_size,layer_type type,int inc_bias,int inc_delta_multiplier);
+void count_network_nodes (int num_layers,int *layer_sizes,int inc_bias,int inc_delta_multiplier,int *num_nodes,int *num_edges);
+int add_layer (dag *mydag,node **layers,int layer_num,int id,int prev_layer_size,int new_layer_size,layer_type type,int inc_bias,int inc_delta_multiplier);
 node **create_basic_network_dag (int num_layers,int *layer_sizes,int inc_bias,int inc_delta_multiplier);
+void benchmark_dag_build (void);
+
+// compressed (template) DAG routines
+template_network *create_template_network (int num_layers,int *layer_sizes,int inc_bias,int inc_delta_multiplier);
+void schedule_templates (template_network *net);
+void compute_template_utilization (template_network *net,argstype *myargs);
+void generate_template_ilp_file (template_network *net,char *filename,argstype *myargs);
+int solve_template_schedule (template_network *net,char *filename);
+void template_register_pressure (template_network *net,int *peak,long *sum);
+void count_template_operations (template_network *net,int *num_adds,int *num_mults);
+node **expand_template_network (template_network *net,int num_layers,int *layer_sizes,int inc_bias,int inc_delta_multiplier);
 
 // scheduling
+extern int node_latency[];
+extern int node_occupancy[];
+extern int schedule_slack;
+extern int schedule_max_ii;
+extern ilp_formulation schedule_formulation;
+extern register_objective schedule_registers;
+extern int schedule_adders;
+extern int schedule_multipliers;
+extern int schedule_ii;
+extern solver_status schedule_status;
 void set_asaps (node *mynode,void *args);
 void set_alaps (node *mynode,void *args);
+void pull_asap (node *mynode);
+void pull_alap (node *mynode);
+void compute_timing (dag *mydag,travordertype travorder);
 void schedule (node *layers[],int num_layers,int num_inputs,int num_outputs);
-void generate_ilp_file (node **layers,
+void set_latency (node *layers[],int num_layers,int num_inputs,node_type type,int latency);
+void set_slack (node *layers[],int num_layers,int num_inputs,int slack);
+void set_max_ii (node *layers[],int num_layers,int num_inputs,int max_ii);
+int busy_cycles (int num_ops,node_type type,int num_units);
+int unit_latency_bound (int num_ops,node_type type,int num_units);
+int unit_available (const int *use,node_type type,int ii,int cycle,int num_units);
+void occupy_unit (int *use,node_type type,int ii,int cycle,int inc);
+int list_schedule (dag *mydag,const int *priority,int num_adders,int num_multipliers,int *start);
+int list_schedule_released (dag *mydag,const int *priority,const int *earliest,const int *fixed,int num_adders,int num_multipliers,int *start);
+int force_directed_schedule (dag *mydag,int num_adders,int num_multipliers,int *start);
+int heuristic_schedule (node *layers[],int num_layers,int num_inputs,int num_outputs);
+void write_mip_start (node *layers[],int num_layers,char *filename);
+void design_sweep (const char *filename);
+void pareto_sweep (const char *filename);
+int generate_ilp_file (node **layers,
 						int num_layers,
 						int num_inputs,
 						int num_outputs,
@@ -254,6 +711,25 @@ int solve_schedule (node **layers,
 						int num_inputs,
 						int num_outputs,
 						char *filename);
+int solve_schedule_status (node **layers,
+						int num_layers,
+						int num_inputs,
+						int num_outputs,
+						char *filename,
+						solver_status *status);
+int solve_adaptive (node **layers,
+						int num_layers,
+						int num_inputs,
+						int num_outputs,
+						char *filename,
+						int upper_bound);
+solver_status run_solver (const char *filename,const char *start_filename,const char *options);
+int read_solution (const char *filename,int **ids,int **cycles);
+int solve_schedule_glpk (node **layers,
+						int num_layers,
+						int num_inputs,
+						int num_outputs);
+void benchmark_formulations (void);
 void tabulate_functional_unit_utilization (node *layers[],int num_layers,int num_inputs,int num_outputs);
 void tabulate_registers (node *layers[],int num_layers,int num_inputs,int num_outputs);
 void tabulate_schedule_by_cycle (node *layers[],int num_layers,int num_inputs,int num_outputs);
@@ -0,0 +1,204 @@
+#include "netscheduler.h"
+
+// register pressure of a schedule: a value is held from the cycle its
+// producer finishes until its last consumer starts (as in count_registers()).
+// reduce_register_pressure() moves nodes within their slack, without giving
+// up latency or unit limits, wherever that shortens the summed lifetimes
+
+// the cycle a node's value is held until (its last consumer's start), or
+// -1 if nothing consumes it
+static int held_until (node *mynode,const int *start) {
+	int last=-1;
+	
+	for (int j=0;j<NUM_OUT_EDGES(mynode);j++)
+		if (start[OUT_EDGE(mynode,j).node_index] > last) last = start[OUT_EDGE(mynode,j).node_index];
+	
+	return last;
+}
+
+// peak and summed (register-cycles) register usage of a schedule, given in
+// start[] or, if that's NULL, in the nodes' scheduled cycles
+void register_pressure (dag *mydag,const int *start,int *peak,long *sum) {
+	int n = mydag->num_nodes;
+	int *cycles = (int *)malloc(sizeof(int)*(n ? n : 1));
+	int max_cycle=0;
+	
+	for (int i=0;i<n;i++) {
+		cycles[i] = start ? start[i] : mydag->nodes[i].scheduled_cycle;
+		if (cycles[i] + NODE_LATENCY(&mydag->nodes[i]) > max_cycle) max_cycle = cycles[i] + NODE_LATENCY(&mydag->nodes[i]);
+	}
+	
+	int *live = (int *)calloc(max_cycle+2,sizeof(int));
+	*sum = 0;
+	for (int i=0;i<n;i++) {
+		int first = cycles[i] + NODE_LATENCY(&mydag->nodes[i]);
+		int last = held_until(&mydag->nodes[i],cycles);
+		
+		if (last <= first) continue;
+		live[first]++;
+		live[last]--;
+		*sum += last - first;
+	}
+	
+	*peak = 0;
+	for (int c=0,registers=0;c<=max_cycle;c++) {
+		registers += live[c];
+		if (registers > *peak) *peak = registers;
+	}
+	
+	free(cycles);
+	free(live);
+}
+
+// add inc to the live count of cycles first..last-1, and return the change
+// of the live counts' sum of squares
+static long add_live (int *live,int first,int last,int inc) {
+	long delta=0;
+	
+	for (int c=first;c<last;c++) {
+		delta += 2*inc*live[c] + 1;
+		live[c] += inc;
+	}
+	
+	return delta;
+}
+
+// move nodes of the schedule in start[] to the cycle in their window (and
+// between their operands and their consumers) that shortens the summed
+// lifetimes most, or, as long as it doesn't lengthen them, spreads the live
+// values most evenly over the cycles (by their counts' sum of squares, which
+// brings down the peak), while a unit is free in it, until no move helps.
+// nodes without consumers only move earlier, so the latency doesn't grow.
+// the DAG's timing must be computed.  returns the summed lifetimes
+long reduce_register_pressure (dag *mydag,int num_adders,int num_multipliers,int *start) {
+	int n = mydag->num_nodes;
+	node_idx *order = topological_order(mydag);
+	int *until = (int *)malloc(sizeof(int)*(n ? n : 1));
+	int *others = (int *)malloc(sizeof(int)*(n ? n : 1));
+	int max_cycle=0;
+	
+	for (int i=0;i<n;i++) {
+		until[i] = held_until(&mydag->nodes[i],start);
+		if (start[i] + NODE_LATENCY(&mydag->nodes[i]) > max_cycle) max_cycle = start[i] + NODE_LATENCY(&mydag->nodes[i]);
+	}
+	
+	// units busy per resource slot (up to the end of the last occupancy),
+	// and live values per cycle
+	int busy_cycle = max_cycle + (OCCUPANCY(ADD) > OCCUPANCY(MULT) ? OCCUPANCY(ADD) : OCCUPANCY(MULT));
+	int *add_use = (int *)calloc(busy_cycle+1,sizeof(int));
+	int *mult_use = (int *)calloc(busy_cycle+1,sizeof(int));
+	int *live = (int *)calloc(max_cycle+1,sizeof(int));
+	for (int i=0;i<n;i++) {
+		if (mydag->nodes[i].type == ADD) occupy_unit(add_use,ADD,schedule_ii,start[i],1);
+		if (mydag->nodes[i].type == MULT) occupy_unit(mult_use,MULT,schedule_ii,start[i],1);
+		add_live(live,start[i] + NODE_LATENCY(&mydag->nodes[i]),until[i],1);
+	}
+	
+	for (int moved=1,pass=0;moved && pass<16;pass++) {
+		moved=0;
+		
+		// consumers first, so producers can follow them
+		for (int i=n-1;i>=0;i--) {
+			node *mynode = &mydag->nodes[order[i]];
+			int *use = mynode->type == ADD ? add_use : mynode->type == MULT ? mult_use : NULL;
+			int num_units = mynode->type == ADD ? num_adders : num_multipliers;
+			int latency = NODE_LATENCY(mynode);
+			int lo = mynode->asap_cycle,hi = mynode->alap_cycle;
+			
+			if (mynode->type == INPUT) continue;
+			
+			for (int j=0;j<NUM_IN_EDGES(mynode);j++) {
+				node *pred = IN_NODE(mynode,j);
+				if (start[pred->index] + NODE_LATENCY(pred) > lo) lo = start[pred->index] + NODE_LATENCY(pred);
+			}
+			for (int j=0;j<NUM_OUT_EDGES(mynode);j++) {
+				int latest = start[OUT_EDGE(mynode,j).node_index] - NODE_LATENCY(mynode);
+				if (latest < hi) hi = latest;
+			}
+			if (!NUM_OUT_EDGES(mynode) && start[mynode->index] < hi) hi = start[mynode->index];
+			if (hi > max_cycle - latency) hi = max_cycle - latency;
+			if (lo >= hi && start[mynode->index] == lo) continue;
+			
+			// where each operand would be held until without this node
+			for (int j=0;j<NUM_IN_EDGES(mynode);j++) {
+				node *pred = IN_NODE(mynode,j);
+				int other=-1;
+				
+				for (int k=0;k<NUM_OUT_EDGES(pred);k++) {
+					node_idx succ = OUT_EDGE(pred,k).node_index;
+					if (succ != mynode->index && start[succ] > other) other = start[succ];
+				}
+				others[j] = other;
+			}
+			
+			// take the node's and its operands' lifetimes out...
+			int current = start[mynode->index];
+			long base = add_live(live,current+latency,until[mynode->index],-1);
+			for (int j=0;j<NUM_IN_EDGES(mynode);j++) {
+				node *pred = IN_NODE(mynode,j);
+				base += add_live(live,start[pred->index]+NODE_LATENCY(pred),until[pred->index],-1);
+			}
+			
+			// ...and try them in every cycle (with the node's unit released)
+			int best = current;
+			long best_gain=0,best_spread=0;
+			if (use) occupy_unit(use,mynode->type,schedule_ii,current,-1);
+			for (int c=lo;c<=hi;c++) {
+				if (c == current || (use && !unit_available(use,mynode->type,schedule_ii,c,num_units))) continue;
+				
+				// its own value is held for c-current cycles less (or more),
+				// and its operands until it, or their other consumers
+				long gain = NUM_OUT_EDGES(mynode) ? c - current : 0;
+				long spread = -base - add_live(live,c+latency,until[mynode->index],1);
+				for (int j=0;j<NUM_IN_EDGES(mynode);j++) {
+					node *pred = IN_NODE(mynode,j);
+					int held = c > others[j] ? c : others[j];
+					
+					gain += until[pred->index] - held;
+					spread -= add_live(live,start[pred->index]+NODE_LATENCY(pred),held,1);
+				}
+				
+				add_live(live,c+latency,until[mynode->index],-1);
+				for (int j=0;j<NUM_IN_EDGES(mynode);j++) {
+					node *pred = IN_NODE(mynode,j);
+					add_live(live,start[pred->index]+NODE_LATENCY(pred),c > others[j] ? c : others[j],-1);
+				}
+				
+				if (gain > best_gain || (gain == best_gain && spread > best_spread)) {
+					best_gain = gain;
+					best_spread = spread;
+					best = c;
+				}
+			}
+			
+			// move the node, and put its unit and the lifetimes back
+			if (use) occupy_unit(use,mynode->type,schedule_ii,best,1);
+			if (best != current) {
+				start[mynode->index] = best;
+				for (int j=0;j<NUM_IN_EDGES(mynode);j++) {
+					node *pred = IN_NODE(mynode,j);
+					until[pred->index] = best > others[j] ? best : others[j];
+				}
+				moved=1;
+			}
+			
+			add_live(live,best+latency,until[mynode->index],1);
+			for (int j=0;j<NUM_IN_EDGES(mynode);j++) {
+				node *pred = IN_NODE(mynode,j);
+				add_live(live,start[pred->index]+NODE_LATENCY(pred),until[pred->index],1);
+			}
+		}
+	}
+	
+	int peak;
+	long sum;
+	register_pressure(mydag,start,&peak,&sum);
+	
+	free(until);
+	free(others);
+	free(add_use);
+	free(mult_use);
+	free(live);
+	
+	return sum;
+}
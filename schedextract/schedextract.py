@@ -13,6 +13,8 @@ def main():
 
     parser.add_argument("--gantt", "-G", default=None, type=pathlib.Path, help="If specified, dump the read schedule to a graphical Gannt chart saved to this file.")
 
+    parser.add_argument("--delays", "-d", action="store_true", help="If specified, print the slowest delay of the adders and multipliers as netscheduler.h defines, for CHAIN_OPERATIONS.")
+
     args = parser.parse_args()
 
     tree = None
@@ -78,6 +80,26 @@ def main():
 
     schedule_items = list(reversed(list(sorted(schedule_items))))
 
+    if args.delays:
+        # The slowest operation of each unit type bounds what can be chained
+        # after it.
+        delays = {"DELAY_ADDER": 0.0, "DELAY_MULTIPLIER": 0.0}
+        for node in G.nodes(data=True):
+            attr = node[1]
+            if "opcode" not in attr:
+                continue
+            opcode = attr["opcode"]
+            if "mul" in opcode:
+                unit = "DELAY_MULTIPLIER"
+            elif "add" in opcode or "sub" in opcode:
+                unit = "DELAY_ADDER"
+            else:
+                continue
+            delays[unit] = max(delays[unit], attr["m_delay"])
+
+        for unit in delays:
+            print("#define {}\t{:.2f}".format(unit, delays[unit]))
+
     if args.gantt is not None:
         # https://www.geeksforgeeks.org/python-basic-gantt-chart-using-matplotlib/
 
@@ -1,82 +1,438 @@
 #include "netscheduler.h"
 
+// current latency model, indexed by node_type (INPUT,MULT,ADD,OUTPUT,ADDBIAS).
+// with chaining, the units' latencies follow from their delays
+#ifdef CHAIN_OPERATIONS
+int node_latency[] = {LATENCY_INPUT,DELAY_CYCLES(DELAY_MULTIPLIER),DELAY_CYCLES(DELAY_ADDER),LATENCY_OUTPUT,DELAY_CYCLES(DELAY_ADDER)};
+#else
+int node_latency[] = {LATENCY_INPUT,LATENCY_MULTIPLIER,LATENCY_ADDER,LATENCY_OUTPUT,LATENCY_ADDER};
+#endif
+
+// current unit occupancy model, indexed by node_type (only ADD and MULT
+// nodes occupy units)
+int node_occupancy[] = {1,OCCUPANCY_MULTIPLIER,OCCUPANCY_ADDER,1,OCCUPANCY_ADDER};
+
+// current latency slack and input II bound
+int schedule_slack = SLACK;
+int schedule_max_ii = MAX_II;
+
+// model written by generate_ilp_file()
+ilp_formulation schedule_formulation = ILP_FORMULATION;
+
+// current functional unit budget
+int schedule_adders = NUM_ADDERS;
+int schedule_multipliers = NUM_MULTIPLIERS;
+
+// register pressure term of the ILP objective
+register_objective schedule_registers = REGISTER_OBJECTIVE;
+
+// initiation interval the resource constraints are folded with (0 for none)
+int schedule_ii = INITIATION_INTERVAL;
+
+// how the last solve_schedule() or solve_schedule_glpk() ended
+solver_status schedule_status = SOLVER_UNSOLVED;
+
 void set_asaps (node *mynode,void *args) {
 	if (mynode->type == INPUT) mynode->asap_cycle = 0;
 
-	edge *myedge = mynode->out_edges;
-	while (myedge) {
-		int latency = LATENCY(mynode->type);
-		myedge->edge->asap_cycle = max(myedge->edge->asap_cycle,mynode->asap_cycle + latency);
-		myedge = myedge->next;
+	for (int i=0;i<NUM_OUT_EDGES(mynode);i++) {
+		node *succ = OUT_NODE(mynode,i);
+		int latency = NODE_LATENCY(mynode);
+		succ->asap_cycle = max(succ->asap_cycle,mynode->asap_cycle + latency);
 	}
 }
 
 void set_alaps (node *mynode,void *args) {
 	//if (mynode->type==OUTPUT) mynode->alap_cycle = mynode->asap_cycle;
 	
-	edge *myedge = mynode->in_edges;
-	while (myedge) {
-		int latency_of_current_node = LATENCY(myedge->edge->type);
-		myedge->edge->alap_cycle = mynode->alap_cycle - latency_of_current_node;
-		myedge = myedge->next;
+	for (int i=0;i<NUM_IN_EDGES(mynode);i++) {
+		node *pred = IN_NODE(mynode,i);
+		int latency_of_current_node = NODE_LATENCY(pred);
+		int alap = mynode->alap_cycle - latency_of_current_node;
+		
+		// each node is visited once, so take the tightest bound over all successors
+		if (pred->alap_cycle == -1 || alap < pred->alap_cycle) pred->alap_cycle = alap;
+	}
+}
+
+// pull form of set_asaps(): reads the (final) ASAPs of the predecessors and
+// writes only this node, so all nodes of one level can be updated concurrently.
+// the result doesn't depend on the node's previous ASAP, so it can also be
+// used to recompute a node after a latency change
+void pull_asap (node *mynode) {
+	int asap = mynode->type == INPUT ? 0 : -1;
+	
+	for (int i=0;i<NUM_IN_EDGES(mynode);i++) {
+		node *pred = IN_NODE(mynode,i);
+		int latency = NODE_LATENCY(pred);
+		if (pred->asap_cycle + latency > asap) asap = pred->asap_cycle + latency;
+	}
+	
+	mynode->asap_cycle = asap;
+}
+
+// pull form of set_alaps().  nodes without successors (the final node) keep
+// their ALAP, which is set from the slack
+void pull_alap (node *mynode) {
+	int latency = NODE_LATENCY(mynode);
+	int alap = NUM_OUT_EDGES(mynode) ? -1 : mynode->alap_cycle;
+	
+	for (int i=0;i<NUM_OUT_EDGES(mynode);i++) {
+		int succ_alap = OUT_NODE(mynode,i)->alap_cycle - latency;
+		if (alap == -1 || succ_alap < alap) alap = succ_alap;
+	}
+	
+	mynode->alap_cycle = alap;
+}
+
+typedef struct {
+	dag *mydag;
+	travordertype travorder;
+	int thread_id;
+	int num_threads;
+	pthread_barrier_t *barrier;
+} timing_worker_args;
+
+static void *timing_worker (void *args) {
+	timing_worker_args *myargs = (timing_worker_args *)args;
+	dag *mydag = myargs->mydag;
+	node_idx *order = mydag->topo_order;
+	
+	for (int l=0;l<mydag->num_levels;l++) {
+		int level = myargs->travorder==FROM_START ? l : mydag->num_levels-1-l;
+		int start = mydag->level_offset[level];
+		int end = mydag->level_offset[level+1];
+		
+		// narrow levels aren't worth splitting, so thread 0 takes them whole
+		if (end-start >= TIMING_LEVEL_GRAIN) {
+			int chunk = (end-start+myargs->num_threads-1)/myargs->num_threads;
+			start += chunk*myargs->thread_id;
+			if (start+chunk < end) end = start+chunk;
+		} else if (myargs->thread_id) {
+			end = start;
+		}
+		
+		for (int i=start;i<end;i++) {
+			if (myargs->travorder==FROM_START)
+				pull_asap(&mydag->nodes[order[i]]);
+			else
+				pull_alap(&mydag->nodes[order[i]]);
+		}
+		
+		// nothing in the next level may be read until this one is complete
+		pthread_barrier_wait(myargs->barrier);
+	}
+	
+	return NULL;
+}
+
+// level-synchronous ASAP (FROM_START) or ALAP (FROM_END) computation.  each
+// node only writes its own cycle, and reads nodes of earlier levels, so the
+// result is identical to the serial traversal regardless of thread count
+void compute_timing (dag *mydag,travordertype travorder) {
+	topological_order(mydag);
+	
+	int num_threads = TIMING_THREADS;
+	if (num_threads < 1) num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (num_threads < 1 || mydag->num_nodes < TIMING_LEVEL_GRAIN) num_threads = 1;
+	
+	pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t)*num_threads);
+	timing_worker_args *args = (timing_worker_args *)malloc(sizeof(timing_worker_args)*num_threads);
+	pthread_barrier_t barrier;
+	pthread_barrier_init(&barrier,NULL,num_threads);
+	
+	for (int i=0;i<num_threads;i++) {
+		args[i].mydag = mydag;
+		args[i].travorder = travorder;
+		args[i].thread_id = i;
+		args[i].num_threads = num_threads;
+		args[i].barrier = &barrier;
+		
+		// the calling thread acts as thread 0
+		if (i && pthread_create(&threads[i],NULL,timing_worker,(void *)&args[i])) {
+			perror("Fatal: creating timing analysis thread");
+			exit(1);
+		}
 	}
+	
+	timing_worker((void *)&args[0]);
+	for (int i=1;i<num_threads;i++) pthread_join(threads[i],NULL);
+	
+	pthread_barrier_destroy(&barrier);
+	free(args);
+	free(threads);
 }
 
 void schedule (node *layers[],int num_layers,int num_inputs,int num_outputs) {
-	argstype myargs;
+	dag *mydag = layers[0]->graph;
+	
+#ifdef CHAIN_OPERATIONS
+	// decide which operations feed their successors within their cycle
+	int num_chained = chain_operations(mydag);
+	logmsg("Chained %d operations into their successors (clock period %.2f ns)",num_chained,CLOCK_PERIOD);
+#endif
 	
 	// set asaps
-	traverse_dag (layers,num_layers,num_inputs,num_outputs,(void *)&myargs,set_asaps,FROM_START);
+	compute_timing (mydag,FROM_START);
 	
 	// set latency slack
-	layers[num_layers]->alap_cycle = layers[num_layers]->asap_cycle + SLACK;
+	layers[num_layers]->alap_cycle = layers[num_layers]->asap_cycle + schedule_slack;
 	
 	// set alaps
-	traverse_dag (layers,num_layers,num_inputs,num_outputs,(void *)&myargs,set_alaps,FROM_END);
+	compute_timing (mydag,FROM_END);
 	
 	// set alaps for inputs, which will hopefully allow for II > 1 (experimental)
 	node *mynode = layers[0];
 	for (int i=0;i<num_inputs;i++) {
-		mynode->alap_cycle = MAX_II;
+		mynode->alap_cycle = schedule_max_ii;
 		mynode = mynode->next;
 	}
+	
+	mydag->timed = 1;
 }
 
-void emit_resource_constraints (node *mynode,void *args) {
-	argstype *myargs = (argstype *)args;
-	FILE *myFile = myargs->file;
-	int cycle = myargs->cycle;
-	node_type type = myargs->type;
-	int *first = &myargs->first;
-	
-	// first, check if we already processed this node to avoid
-	// multiple instances of the same node in one constraint
-	if (!mynode->flag) {
-		
-		// next, check if there is any potential for using all of the resources
-		// in this cycle
-		if (((mynode->type == ADD || mynode->type == ADDBIAS) && myargs->add_use[cycle] > NUM_ADDERS) ||
-			(mynode->type == MULT && myargs->mult_use[cycle] > NUM_MULTIPLIERS)) {
-		
-			// finally, check if the node can potentially be used in this cycle
-			if (mynode->type == type &&
-				mynode->asap_cycle <= cycle &&
-				mynode->alap_cycle >= cycle) {
-				
-				// join variables with addition
-				if (!*first) {
-					fprintf(myFile," + ");
-				} else {
-					*first=0;
-				}
-				
-				fprintf(myFile,"n_%d_c_%d",mynode->id,cycle);
+// worklist for incremental re-timing: dirty nodes are bucketed by topological
+// level and drained level by level (ascending for ASAP, descending for ALAP),
+// so a node is only recomputed after every dirty node it depends on
+typedef struct {
+	dag *mydag;
+	node_idx *bucket_head;
+	node_idx *next_dirty;
+} retime_worklist;
+
+#define RETIME_NONE	((node_idx)-1)
+
+static void retime_push (retime_worklist *w,node *mynode) {
+	// each node enters the worklist at most once per pass
+	if (VISITED(mynode)) return;
+	MARK_VISITED(mynode);
+	
+	int level = w->mydag->node_level[mynode->index];
+	w->next_dirty[mynode->index] = w->bucket_head[level];
+	w->bucket_head[level] = mynode->index;
+}
+
+// recompute the dirty nodes in dependency order, and only dirty the
+// neighbors of nodes whose window actually moved
+static void retime_propagate (retime_worklist *w,travordertype travorder) {
+	dag *mydag = w->mydag;
+	
+	for (int l=0;l<mydag->num_levels;l++) {
+		int level = travorder==FROM_START ? l : mydag->num_levels-1-l;
+		
+		// neighbors are always pushed into later levels, never this one
+		while (w->bucket_head[level] != RETIME_NONE) {
+			node *mynode = &mydag->nodes[w->bucket_head[level]];
+			w->bucket_head[level] = w->next_dirty[mynode->index];
+			
+			if (travorder==FROM_START) {
+				int old = mynode->asap_cycle;
+				pull_asap(mynode);
+				if (mynode->asap_cycle != old)
+					for (int i=0;i<NUM_OUT_EDGES(mynode);i++) retime_push(w,OUT_NODE(mynode,i));
+			} else {
+				int old = mynode->alap_cycle;
+				pull_alap(mynode);
+				if (mynode->alap_cycle != old)
+					for (int i=0;i<NUM_IN_EDGES(mynode);i++) retime_push(w,IN_NODE(mynode,i));
+			}
+		}
+	}
+}
+
+// incrementally update the ASAP/ALAP windows of a DAG previously passed to
+// schedule(), after a change to the latency of the node types in latency_mask
+// (bit t for node_type t), the slack, or the input II bound
+static void retime (node *layers[],int num_layers,int num_inputs,int latency_mask) {
+	dag *mydag = layers[0]->graph;
+	node *final_node = layers[num_layers];
+	retime_worklist w;
+	
+	topological_order(mydag);
+	w.mydag = mydag;
+	w.bucket_head = (node_idx *)malloc(sizeof(node_idx)*(mydag->num_levels ? mydag->num_levels : 1));
+	w.next_dirty = (node_idx *)malloc(sizeof(node_idx)*(mydag->num_nodes ? mydag->num_nodes : 1));
+	for (int l=0;l<mydag->num_levels;l++) w.bucket_head[l] = RETIME_NONE;
+	
+	// a node's ASAP depends on its predecessors' latencies
+	if (latency_mask) {
+		clear_flags(mydag);
+		for (int i=0;i<mydag->num_nodes;i++) {
+			node *mynode = &mydag->nodes[i];
+			if (latency_mask & (1<<mynode->type))
+				for (int j=0;j<NUM_OUT_EDGES(mynode);j++) retime_push(&w,OUT_NODE(mynode,j));
+		}
+		retime_propagate(&w,FROM_START);
+	}
+	
+	// a node's ALAP depends on its own latency, and everything depends on
+	// the final node's ALAP
+	clear_flags(mydag);
+	if (latency_mask) {
+		for (int i=0;i<mydag->num_nodes;i++) {
+			node *mynode = &mydag->nodes[i];
+			if ((latency_mask & (1<<mynode->type)) && NUM_OUT_EDGES(mynode)) retime_push(&w,mynode);
+		}
+	}
+	
+	int final_alap = final_node->asap_cycle + schedule_slack;
+	if (final_node->alap_cycle != final_alap) {
+		final_node->alap_cycle = final_alap;
+		for (int i=0;i<NUM_IN_EDGES(final_node);i++) retime_push(&w,IN_NODE(final_node,i));
+	}
+	retime_propagate(&w,FROM_END);
+	
+	free(w.bucket_head);
+	free(w.next_dirty);
+	
+	// inputs are always pinned to the II bound
+	node *mynode = layers[0];
+	for (int i=0;i<num_inputs;i++) {
+		mynode->alap_cycle = schedule_max_ii;
+		mynode = mynode->next;
+	}
+}
+
+void set_latency (node *layers[],int num_layers,int num_inputs,node_type type,int latency) {
+	int latency_mask = 1<<type;
+	
+	// ADD and ADDBIAS nodes share the adder
+	if (type == ADD || type == ADDBIAS) latency_mask = (1<<ADD) | (1<<ADDBIAS);
+	
+	for (int t=INPUT;t<=ADDBIAS;t++) {
+		if (!(latency_mask & (1<<t))) continue;
+		if (node_latency[t] == latency) latency_mask &= ~(1<<t);
+		node_latency[t] = latency;
+	}
+	
+#ifdef CHAIN_OPERATIONS
+	// only single-cycle units chain, so the chains may change anywhere
+	if (latency_mask) {
+		chain_operations(layers[0]->graph);
+		latency_mask = (1<<(ADDBIAS+1))-1;
+	}
+#endif
+	
+	if (latency_mask) retime(layers,num_layers,num_inputs,latency_mask);
+}
+
+void set_slack (node *layers[],int num_layers,int num_inputs,int slack) {
+	schedule_slack = slack;
+	retime(layers,num_layers,num_inputs,0);
+}
+
+void set_max_ii (node *layers[],int num_layers,int num_inputs,int max_ii) {
+	schedule_max_ii = max_ii;
+	retime(layers,num_layers,num_inputs,0);
+}
+
+// the ADD or MULT nodes that may keep a unit busy in each cycle, bucketed by
+// cycle in traversal order: the nodes of cycle c are nodes[start[c]..start[c+1]-1],
+// each occupying the cycle if it starts in the matching node_start[] cycle.
+// under the initiation interval, only the first OCCUPIED_SLOTS() cycles of
+// an occupancy are listed (the rest fold onto their slots, see SLOT_WEIGHT()).
+// the buckets run up to last_cycle, the last cycle a unit may be busy in
+typedef struct {
+	int *start;
+	node_idx *nodes;
+	int *node_start;
+	int last_cycle;
+	node_type type;
+} cycle_index;
+
+static void build_cycle_index (dag *mydag,node_type type,int last_cycle,cycle_index *idx) {
+	node_idx *order = topological_order(mydag);
+	int occupied = OCCUPIED_SLOTS(type,schedule_ii);
+	int total=0;
+	
+	idx->type = type;
+	idx->last_cycle = last_cycle + occupied - 1;
+	idx->start = (int *)calloc(idx->last_cycle+3,sizeof(int));
+	
+	// count the window of every node two buckets ahead, so the prefix sum
+	// leaves the beginning of cycle c's bucket in start[c+1]...
+	for (int i=0;i<mydag->num_nodes;i++) {
+		node *mynode = &mydag->nodes[order[i]];
+		if (mynode->type != type) continue;
+		for (int c=mynode->asap_cycle;c<=mynode->alap_cycle && c<=last_cycle;c++)
+			for (int k=0;k<occupied;k++) idx->start[c+k+2]++;
+	}
+	
+	for (int c=2;c<=idx->last_cycle+2;c++) {
+		total += idx->start[c];
+		idx->start[c] = total;
+	}
+	
+	idx->nodes = (node_idx *)malloc(sizeof(node_idx)*(total ? total : 1));
+	idx->node_start = (int *)malloc(sizeof(int)*(total ? total : 1));
+	
+	// ...and filling it through that cursor moves it to start[c+1]
+	for (int i=0;i<mydag->num_nodes;i++) {
+		node *mynode = &mydag->nodes[order[i]];
+		if (mynode->type != type) continue;
+		for (int c=mynode->asap_cycle;c<=mynode->alap_cycle && c<=last_cycle;c++) {
+			for (int k=0;k<occupied;k++) {
+				idx->node_start[idx->start[c+k+1]] = c;
+				idx->nodes[idx->start[c+k+1]++] = order[i];
 			}
 		}
-		mynode->flag=1;
 	}
 }
 
+static void free_cycle_index (cycle_index *idx) {
+	free(idx->start);
+	free(idx->nodes);
+	free(idx->node_start);
+}
+
+// units that the (node, start cycle) pairs which may occupy a resource slot,
+// i.e. any of its cycles, would keep busy in it all together, which bounds
+// the units busy in the slot
+static int slot_candidates (cycle_index *idx,int slot) {
+	int count=0;
+	
+	for (int c=slot;c<=idx->last_cycle;c+=RESOURCE_SLOTS(idx->last_cycle)) {
+		if (!schedule_ii || OCCUPANCY(idx->type) <= schedule_ii) {
+			count += idx->start[c+1] - idx->start[c];
+			continue;
+		}
+		for (int i=idx->start[c];i<idx->start[c+1];i++) count += SLOT_WEIGHT(idx->type,schedule_ii,c - idx->node_start[i]);
+	}
+	
+	return count;
+}
+
+// the nodes that may occupy a slot, from the utilization counted by
+// compute_functional_utilization() while a slot is one cycle of single
+// cycle units
+static int slot_use (cycle_index *idx,const int *use,int slot) {
+	if (!schedule_ii && OCCUPANCY(idx->type) == 1) return use[slot];
+	
+	return slot_candidates(idx,slot);
+}
+
+// write one resource slot's constraint (one cycle, or every cycle folded
+// onto it by the initiation interval) over the variables named prefix, if
+// more nodes could occupy the slot (candidates) than there are units
+static void emit_resource_constraint (FILE *myFile,dag *mydag,cycle_index *idx,const char *prefix,int slot,int candidates,int num_units) {
+	int first_term=1;
+	
+	if (candidates <= num_units) return;
+	
+	for (int c=slot;c<=idx->last_cycle;c+=RESOURCE_SLOTS(idx->last_cycle)) {
+		for (int i=idx->start[c];i<idx->start[c+1];i++) {
+			node *mynode = &mydag->nodes[idx->nodes[i]];
+			int weight = SLOT_WEIGHT(idx->type,schedule_ii,c - idx->node_start[i]);
+			
+			if (!first_term) fprintf(myFile," + ");
+			if (weight > 1) fprintf(myFile,"%d ",weight);
+			fprintf(myFile,"%s_%d_c_%d",prefix,mynode->id,idx->node_start[i]);
+			first_term=0;
+		}
+	}
+	fprintf(myFile," <= %d\n",num_units);
+}
+
 void emit_start_and_dependency_constraints (node *mynode,void *args) {
 	FILE *myFile = ((argstype *)args)->file;
 	
@@ -90,9 +446,8 @@ void emit_start_and_dependency_constraints (node *mynode,void *args) {
 	
 	// add data dependency constraints
 	fprintf (myFile,"\\ data dependency constraint\n");
-	edge *myedge = mynode->in_edges;
-	while (myedge) {
-		node *pred = myedge->edge;
+	for (int j=0;j<NUM_IN_EDGES(mynode);j++) {
+		node *pred = IN_NODE(mynode,j);
 		for (int i=mynode->asap_cycle;i<=mynode->alap_cycle;i++) {
 			if (i!=mynode->asap_cycle) fprintf (myFile," + ");
 			fprintf(myFile,"%d n_%d_c_%d",i,mynode->id,i);
@@ -103,8 +458,7 @@ void emit_start_and_dependency_constraints (node *mynode,void *args) {
 			fprintf(myFile," - %d n_%d_c_%d",i,pred->id,i);
 		}
 		
-		fprintf(myFile," >= %d\n",LATENCY(pred->type));
-		myedge = myedge->next;
+		fprintf(myFile," >= %d\n",NODE_LATENCY(pred));
 	}
 }
 
@@ -128,45 +482,39 @@ void emit_op_constraints (node *mynode,void *args) {
 
 void emit_vector_constraints (node *mynode,void *args) {
 
-	if (!mynode->flag) {
-		FILE *myFile = ((argstype *)args)->file;
+	FILE *myFile = ((argstype *)args)->file;
 
-		fprintf (myFile,"\\ vector constraints\n");
+	fprintf (myFile,"\\ vector constraints\n");
 
-		int min_asap = 1000;
-		int max_alap = 0;
-		int num_inputs = 0;
+	int min_asap = 1000;
+	int max_alap = 0;
+	int num_inputs = 0;
 
-		// NOTE: this only works for 0 to 2 predecessor nodes
-		edge *myedge = mynode->in_edges;
-		while (myedge) {
-			node *in_node = myedge->edge;
+	// NOTE: this only works for 0 to 2 predecessor nodes
+	for (int j=0;j<NUM_IN_EDGES(mynode);j++) {
+		node *in_node = IN_NODE(mynode,j);
 
-			if (in_node->asap_cycle < min_asap) {
-				min_asap = in_node->asap_cycle;
-			}
-			if (in_node->alap_cycle > max_alap) {
-				max_alap = in_node->alap_cycle;
-			}
-			num_inputs++;
-			myedge = myedge->next;
+		if (in_node->asap_cycle < min_asap) {
+			min_asap = in_node->asap_cycle;
 		}
+		if (in_node->alap_cycle > max_alap) {
+			max_alap = in_node->alap_cycle;
+		}
+		num_inputs++;
+	}
 
-		if (num_inputs==2) {
-			// don't allow the predecessors to complete at the same time, since this will put the
-			// results into the same vector element
+	if (num_inputs==2) {
+		// don't allow the predecessors to complete at the same time, since this will put the
+		// results into the same vector element
 
-			for (int i=min_asap;i<=max_alap;i++) {
-				int first_pred_id = mynode->in_edges->edge->id;
-				int second_pred_id = mynode->in_edges->next->edge->id;
+		for (int i=min_asap;i<=max_alap;i++) {
+			int first_pred_id = IN_NODE(mynode,0)->id;
+			int second_pred_id = IN_NODE(mynode,1)->id;
 
-				if (i!=min_asap) fprintf(myFile,"+ ");
-				fprintf(myFile,"%d n_%d_c_%d - %d n_%d_c_%d ",i,first_pred_id,i,i,second_pred_id,i);
-			}
-			fprintf(myFile,"< 0\n");
+			if (i!=min_asap) fprintf(myFile,"+ ");
+			fprintf(myFile,"%d n_%d_c_%d - %d n_%d_c_%d ",i,first_pred_id,i,i,second_pred_id,i);
 		}
-
-		mynode->flag=1;
+		fprintf(myFile,"< 0\n");
 	}
 }
 
@@ -174,21 +522,302 @@ void generate_declarations (node *mynode,void *args) {
 	argstype *myargs = (argstype *)args;
 	FILE *myFile = myargs->file;
 	
-	if (!mynode->flag) {
-		for (int i=mynode->asap_cycle;i<=mynode->alap_cycle;i++)
-			fprintf(myFile,"n_%d_c_%d\n",mynode->id,i);
-		mynode->flag=1;
+	for (int i=mynode->asap_cycle;i<=mynode->alap_cycle;i++)
+		fprintf(myFile,"n_%d_c_%d\n",mynode->id,i);
+}
+
+// write sign times a node's start: s_<id> in the start-time model, the sum
+// of its window's cycles in the time-indexed one
+static void emit_start_term (FILE *myFile,node *mynode,char sign) {
+	if (schedule_formulation == ILP_START_TIME) {
+		fprintf(myFile," %c s_%d",sign,mynode->id);
+		return;
+	}
+	
+	for (int c=mynode->asap_cycle;c<=mynode->alap_cycle;c++)
+		if (c) fprintf(myFile," %c %d n_%d_c_%d",sign,c,mynode->id,c);
+}
+
+// register pressure terms of the objective (see REGISTER_OBJECTIVE): the
+// lifetimes e_<id> - start of the values, or the peak register count
+static void emit_register_objective (FILE *myFile,dag *mydag) {
+	if (schedule_registers == REGISTERS_PEAK) {
+		fprintf(myFile," + registers");
+		return;
+	}
+	
+	for (int i=0;i<mydag->num_nodes;i++) {
+		node *mynode = &mydag->nodes[i];
+		
+		if (!NUM_OUT_EDGES(mynode)) continue;
+		fprintf(myFile," + e_%d",mynode->id);
+		emit_start_term(myFile,mynode,'-');
+	}
+}
+
+// register pressure constraints.  a value's lifetime e_<id> ends no earlier
+// than any consumer starts.  for the peak, l_<id>_c_<cycle> is 1 if the
+// value is held in the cycle, i.e. its producer finished and some consumer
+// hasn't started, and registers bounds their sum in every cycle.  returns
+// the number of variables added
+static int emit_register_constraints (FILE *myFile,dag *mydag,int last_cycle) {
+	int num_variables=0;
+	
+	fprintf (myFile,"\\ register pressure constraints\n");
+	
+	if (schedule_registers == REGISTERS_SUM) {
+		for (int i=0;i<mydag->num_nodes;i++) {
+			node *mynode = &mydag->nodes[i];
+			
+			if (!NUM_OUT_EDGES(mynode)) continue;
+			num_variables++;
+			
+			for (int j=0;j<NUM_OUT_EDGES(mynode);j++) {
+				fprintf(myFile,"e_%d",mynode->id);
+				emit_start_term(myFile,OUT_NODE(mynode,j),'-');
+				fprintf(myFile," >= 0\n");
+			}
+		}
+		
+		return num_variables;
+	}
+	
+	// the cycles a value may be held in: from its earliest finish to its
+	// last consumer's latest start
+	int *last_held = (int *)malloc(sizeof(int)*(mydag->num_nodes ? mydag->num_nodes : 1));
+	
+	for (int i=0;i<mydag->num_nodes;i++) {
+		node *mynode = &mydag->nodes[i];
+		int finish = mynode->asap_cycle + NODE_LATENCY(mynode);
+		
+		last_held[i] = -1;
+		for (int j=0;j<NUM_OUT_EDGES(mynode);j++) {
+			node *succ = OUT_NODE(mynode,j);
+			
+			if (succ->alap_cycle-1 > last_held[i]) last_held[i] = succ->alap_cycle-1;
+			
+			for (int c=finish;c<succ->alap_cycle;c++) {
+				fprintf(myFile,"l_%d_c_%d",mynode->id,c);
+				for (int k=mynode->asap_cycle;k<=mynode->alap_cycle && k<=c-NODE_LATENCY(mynode);k++)
+					fprintf(myFile," - n_%d_c_%d",mynode->id,k);
+				for (int k=succ->asap_cycle;k<=succ->alap_cycle && k<=c;k++)
+					fprintf(myFile," + n_%d_c_%d",succ->id,k);
+				fprintf(myFile," >= 0\n");
+			}
+		}
+		if (last_held[i] >= finish) num_variables += last_held[i] - finish + 1;
+	}
+	
+	for (int c=0;c<=last_cycle;c++) {
+		fprintf(myFile,"registers");
+		for (int i=0;i<mydag->num_nodes;i++) {
+			node *mynode = &mydag->nodes[i];
+			if (c >= mynode->asap_cycle + NODE_LATENCY(mynode) && c <= last_held[i])
+				fprintf(myFile," - l_%d_c_%d",mynode->id,c);
+		}
+		fprintf(myFile," >= 0\n");
+	}
+	
+	free(last_held);
+	
+	return num_variables+1;
+}
+
+// integer declarations of the lifetimes (the peak's variables are continuous)
+static void emit_register_declarations (FILE *myFile,dag *mydag) {
+	if (schedule_registers != REGISTERS_SUM) return;
+	
+	for (int i=0;i<mydag->num_nodes;i++)
+		if (NUM_OUT_EDGES(&mydag->nodes[i])) fprintf(myFile,"e_%d\n",mydag->nodes[i].id);
+}
+
+// write the start-time model: one integer s_<id> per node bounded by its
+// window, and a difference constraint per edge.  per-cycle resource rows are
+// only needed in the cycles where more ADD or MULT nodes may start than
+// there are units, so only the nodes whose window meets such a cycle get
+// time-indexed binaries b_<id>_c_<cycle>, tied to their start time.
+// returns the number of variables
+static int generate_start_time_ilp_file (node **layers,int num_layers,char *filename) {
+	dag *mydag = layers[0]->graph;
+	node_idx *order = topological_order(mydag);
+	int last_cycle = layers[num_layers]->alap_cycle;
+	int num_variables = mydag->num_nodes;
+	FILE *myFile;
+	char str[1024];
+	
+	myFile=fopen(filename,"w+");
+	if (!myFile) {
+		snprintf(str,1024,"ERROR: opening \"%s\" for write",filename);
+		perror(str);
+		exit(1);
+	}
+	
+	cycle_index add_index,mult_index;
+	build_cycle_index(mydag,ADD,last_cycle,&add_index);
+	build_cycle_index(mydag,MULT,last_cycle,&mult_index);
+	
+	// decide which cycles can bind, and so which nodes need binaries (those
+	// that may occupy a unit in such a cycle)
+	int busy_cycle = add_index.last_cycle > mult_index.last_cycle ? add_index.last_cycle : mult_index.last_cycle;
+	char *add_binds = (char *)calloc(busy_cycle+1,1);
+	char *mult_binds = (char *)calloc(busy_cycle+1,1);
+	char *needs_binaries = (char *)calloc(mydag->num_nodes ? mydag->num_nodes : 1,1);
+	
+	for (int c=0;c<=busy_cycle;c++) {
+		add_binds[c] = c <= add_index.last_cycle && slot_candidates(&add_index,RESOURCE_SLOT(c)) > schedule_adders;
+		mult_binds[c] = c <= mult_index.last_cycle && slot_candidates(&mult_index,RESOURCE_SLOT(c)) > schedule_multipliers;
+	}
+	
+	for (int i=0;i<mydag->num_nodes;i++) {
+		node *mynode = &mydag->nodes[i];
+		char *binds = mynode->type == ADD ? add_binds : mynode->type == MULT ? mult_binds : NULL;
+		
+		if (!binds) continue;
+		for (int c=mynode->asap_cycle;c<=mynode->alap_cycle+OCCUPIED_SLOTS(mynode->type,schedule_ii)-1 && c<=busy_cycle;c++) {
+			if (binds[c]) {
+				needs_binaries[i] = 1;
+				num_variables += mynode->alap_cycle - mynode->asap_cycle + 1;
+				break;
+			}
+		}
+	}
+	
+	// add latency objective function
+	fprintf (myFile,"minimize\n\n");
+	if (schedule_registers == REGISTERS_NONE) {
+		fprintf (myFile,"s_%d\n",layers[num_layers]->id);
+	} else {
+		if (REGISTER_LATENCY_WEIGHT) fprintf (myFile,"%d s_%d",REGISTER_LATENCY_WEIGHT,layers[num_layers]->id);
+		emit_register_objective(myFile,mydag);
+		fprintf (myFile,"\n");
+	}
+	
+	fprintf (myFile,"\nsubject to\n\n");
+	
+	fprintf (myFile,"\\ data dependency constraints\n");
+	for (int i=0;i<mydag->num_nodes;i++) {
+		node *mynode = &mydag->nodes[order[i]];
+		
+		for (int j=0;j<NUM_IN_EDGES(mynode);j++) {
+			node *pred = IN_NODE(mynode,j);
+			fprintf(myFile,"s_%d - s_%d >= %d\n",mynode->id,pred->id,NODE_LATENCY(pred));
+		}
+	}
+	
+	fprintf (myFile,"\\ start time of nodes with binaries\n");
+	for (int i=0;i<mydag->num_nodes;i++) {
+		node *mynode = &mydag->nodes[order[i]];
+		
+		if (!needs_binaries[order[i]]) continue;
+		
+		for (int c=mynode->asap_cycle;c<=mynode->alap_cycle;c++) {
+			if (c!=mynode->asap_cycle) fprintf (myFile," + ");
+			fprintf(myFile,"b_%d_c_%d",mynode->id,c);
+		}
+		fprintf (myFile," = 1\n");
+		
+		fprintf(myFile,"s_%d",mynode->id);
+		for (int c=mynode->asap_cycle;c<=mynode->alap_cycle;c++)
+			fprintf(myFile," - %d b_%d_c_%d",c,mynode->id,c);
+		fprintf (myFile," = 0\n");
+	}
+	
+	fprintf (myFile,"\\ resource constraints\n");
+	for (int slot=0;slot<RESOURCE_SLOTS(busy_cycle);slot++) {
+		emit_resource_constraint(myFile,mydag,&mult_index,"b",slot,slot_candidates(&mult_index,slot),schedule_multipliers);
+		emit_resource_constraint(myFile,mydag,&add_index,"b",slot,slot_candidates(&add_index,slot),schedule_adders);
+	}
+	
+#ifdef NEURON_SYMMETRY_BREAKING
+	node_idx *pairs;
+	int num_pairs = neuron_symmetry_pairs(mydag,&pairs);
+	
+	fprintf (myFile,"\\ symmetry breaking constraints\n");
+	for (int i=0;i<num_pairs;i++)
+		fprintf(myFile,"s_%d - s_%d <= 0\n",mydag->nodes[pairs[2*i]].id,mydag->nodes[pairs[2*i+1]].id);
+	free(pairs);
+#endif
+	
+	if (schedule_registers != REGISTERS_NONE) num_variables += emit_register_constraints(myFile,mydag,last_cycle);
+	
+	// add declarations
+	fprintf (myFile,"\nbounds\n\n");
+	for (int i=0;i<mydag->num_nodes;i++) {
+		node *mynode = &mydag->nodes[order[i]];
+		fprintf(myFile,"%d <= s_%d <= %d\n",mynode->asap_cycle,mynode->id,mynode->alap_cycle);
+	}
+	
+	fprintf (myFile,"\ngeneral\n\n");
+	for (int i=0;i<mydag->num_nodes;i++) fprintf(myFile,"s_%d\n",mydag->nodes[order[i]].id);
+	emit_register_declarations(myFile,mydag);
+	
+	fprintf (myFile,"\nbinary\n\n");
+	for (int i=0;i<mydag->num_nodes;i++) {
+		node *mynode = &mydag->nodes[order[i]];
+		
+		if (!needs_binaries[order[i]]) continue;
+		for (int c=mynode->asap_cycle;c<=mynode->alap_cycle;c++)
+			fprintf(myFile,"b_%d_c_%d\n",mynode->id,c);
+	}
+	
+	fprintf (myFile,"\nend\n");
+	
+	fclose(myFile);
+	
+	free(add_binds);
+	free(mult_binds);
+	free(needs_binaries);
+	free_cycle_index(&add_index);
+	free_cycle_index(&mult_index);
+	
+	return num_variables;
+}
+
+#ifdef NEURON_SYMMETRY_BREAKING
+// order the start times of symmetric neurons (see neuron_symmetry_pairs())
+static void emit_symmetry_constraints (dag *mydag,FILE *myFile) {
+	node_idx *pairs;
+	int num_pairs = neuron_symmetry_pairs(mydag,&pairs);
+	
+	fprintf (myFile,"\\ symmetry breaking constraints\n");
+	for (int i=0;i<num_pairs;i++) {
+		node *first = &mydag->nodes[pairs[2*i]];
+		node *second = &mydag->nodes[pairs[2*i+1]];
+		
+		for (int c=first->asap_cycle;c<=first->alap_cycle;c++) {
+			if (c!=first->asap_cycle) fprintf (myFile," + ");
+			fprintf(myFile,"%d n_%d_c_%d",c,first->id,c);
+		}
+		for (int c=second->asap_cycle;c<=second->alap_cycle;c++)
+			fprintf(myFile," - %d n_%d_c_%d",c,second->id,c);
+		fprintf(myFile," <= 0\n");
 	}
+	
+	free(pairs);
 }
+#endif
 
-void generate_ilp_file (node **layers,
+int generate_ilp_file (node **layers,
 						int num_layers,
 						int num_inputs,
 						int num_outputs,
 						char *filename,
 						argstype *myargs) {
 							
+	if (schedule_formulation == ILP_START_TIME) {
+#ifdef VECTORIZE
+		fprintf(stderr,"Fatal: the vector unit constraints need the time-indexed ILP formulation.\n");
+		exit(1);
+#endif
+		if (schedule_registers == REGISTERS_PEAK) {
+			fprintf(stderr,"Fatal: the peak register objective needs the time-indexed ILP formulation.\n");
+			exit(1);
+		}
+		return generate_start_time_ilp_file(layers,num_layers,filename);
+	}
+	
 	int last_cycle = layers[num_layers]->alap_cycle;
+	int num_variables = 0;
 	FILE *myFile;
 	char str[1024];
 	
@@ -204,10 +833,12 @@ void generate_ilp_file (node **layers,
 	
 	int earliest_completion = layers[num_layers]->asap_cycle;
 	int latest_completion = layers[num_layers]->alap_cycle;
-	for (int i = earliest_completion;i<=latest_completion;i++) {
+	int latency_weight = schedule_registers == REGISTERS_NONE ? 1 : REGISTER_LATENCY_WEIGHT;
+	for (int i = earliest_completion;i<=latest_completion && latency_weight;i++) {
 		if (i!=earliest_completion) fprintf(myFile," + ");
-		fprintf (myFile,"%d n_%d_c_%d",i,layers[num_layers]->id,i);
+		fprintf (myFile,"%d n_%d_c_%d",latency_weight*i,layers[num_layers]->id,i);
 	}
+	if (schedule_registers != REGISTERS_NONE) emit_register_objective(myFile,layers[0]->graph);
 	fprintf(myFile,"\n");
 	
 	fprintf (myFile,"\nsubject to\n\n");
@@ -226,77 +857,38 @@ void generate_ilp_file (node **layers,
 	
 	fprintf (myFile,"\\ resource constraints\n");
 	
-	// define resource constraint for each cycle
-	for (myargs->cycle = 0;myargs->cycle <= last_cycle;myargs->cycle++) {
-		
-		// clear flags
-		traverse_dag (layers,
-				  num_layers,
-				  num_inputs,
-				  num_outputs,
-				  (void *)myargs,
-				  clear_flags,
-				  FROM_START);
+	// define resource constraint for each cycle (or each slot of the
+	// initiation interval), straight from the nodes that may occupy it
+	cycle_index add_index,mult_index;
+	build_cycle_index(layers[0]->graph,ADD,last_cycle,&add_index);
+	build_cycle_index(layers[0]->graph,MULT,last_cycle,&mult_index);
+	
+	int busy_cycle = add_index.last_cycle > mult_index.last_cycle ? add_index.last_cycle : mult_index.last_cycle;
+	for (int slot=0;slot<RESOURCE_SLOTS(busy_cycle);slot++) {
+		emit_resource_constraint(myFile,layers[0]->graph,&mult_index,"n",slot,slot_use(&mult_index,myargs->mult_use,slot),schedule_multipliers);
+		emit_resource_constraint(myFile,layers[0]->graph,&add_index,"n",slot,slot_use(&add_index,myargs->add_use,slot),schedule_adders);
+	}
+	
+	free_cycle_index(&add_index);
+	free_cycle_index(&mult_index);
+	
+#ifdef NEURON_SYMMETRY_BREAKING
+	emit_symmetry_constraints(layers[0]->graph,myFile);
+#endif
+	
+	if (schedule_registers != REGISTERS_NONE) num_variables += emit_register_constraints(myFile,layers[0]->graph,last_cycle);
+	
+#ifdef VECTORIZE
 		
-		// set constraints for multipliers
-		myargs->type=MULT;
+		// set constraints for adders
+		myargs->type=ADD;
 		myargs->first=1;
 		traverse_dag (layers,
 					  num_layers,
 					  num_inputs,
 					  num_outputs,
 					  (void *)myargs,
-					  emit_resource_constraints,
-					  FROM_START);
-					  
-		if (!myargs->first) {
-			fprintf(myFile," <= %d\n",NUM_MULTIPLIERS);
-		}
-		
-		// clear flags
-		traverse_dag (layers,
-				  num_layers,
-				  num_inputs,
-				  num_outputs,
-				  (void *)myargs,
-				  clear_flags,
-				  FROM_START);
-		
-		// set constraints for adders
-		myargs->type=ADD;
-		myargs->first=1;
-		traverse_dag (layers,
-					  num_layers,
-					  num_inputs,
-					  num_outputs,
-					  (void *)myargs,
-					  emit_resource_constraints,
-					  FROM_START);
-		
-		if (!myargs->first) {
-			fprintf(myFile," <= %d\n",NUM_ADDERS);
-		}
-	}
-	
-#ifdef VECTORIZE
-		// clear flags
-		traverse_dag (layers,
-				  num_layers,
-				  num_inputs,
-				  num_outputs,
-				  (void *)myargs,
-				  clear_flags,
-				  FROM_START);
-		
-		// set constraints for adders
-		myargs->type=ADD;
-		myargs->first=1;
-		traverse_dag (layers,
-					  num_layers,
-					  num_inputs,
-					  num_outputs,
-					  (void *)myargs,
-					  emit_vector_constraints,
+					  emit_vector_constraints,
 					  FROM_START);
 
 		fprintf(myFile,"\\ operation constraints for vector unit\n");
@@ -320,14 +912,6 @@ void generate_ilp_file (node **layers,
 	// add declarations
 	fprintf (myFile,"\n\\ declarations\n");
 	fprintf (myFile,"\ninteger\n\n");
-	// clear flags
-	traverse_dag (layers,
-			  num_layers,
-			  num_inputs,
-			  num_outputs,
-			  (void *)myargs,
-			  clear_flags,
-			  FROM_START);
 			  
 	traverse_dag (layers,
 				  num_layers,
@@ -336,64 +920,115 @@ void generate_ilp_file (node **layers,
 				  (void *)myargs,
 				  generate_declarations,
 				  FROM_START);
+	emit_register_declarations(myFile,layers[0]->graph);
 
 	fprintf (myFile,"\nend\n");
 	
 	fclose(myFile);
-}
-
-void apply_schedule (node *mynode,void *args) {
-	argstype *myargs = (argstype *)args;
 	
-	if (mynode->id == myargs->id) mynode->scheduled_cycle = myargs->cycle;
+	dag *mydag = layers[0]->graph;
+	for (int i=0;i<mydag->num_nodes;i++)
+		num_variables += mydag->nodes[i].alap_cycle - mydag->nodes[i].asap_cycle + 1;
+	
+	return num_variables;
 }
 
-int solve_schedule (node **layers,
-						int num_layers,
-						int num_inputs,
-						int num_outputs,
-						char *filename) {
-
+// how the solver ended, from the final status in Gurobi's log or the
+// status line of glpsol's solution: anything else is SOLVER_UNSOLVED
+static solver_status read_solver_status (const char *status_filename) {
 	FILE *myFile;
-	char str[1024],shell_command[1024],output_filename[1024],filename_prefix[1024];
-	int ret,id,cycle;
+	char str[1024];
+	solver_status status = SOLVER_UNSOLVED;
 	
-	// make sure we can open the LP file
-	myFile = fopen(filename,"r+");
-	if (!myFile) {
-		snprintf(str,1024,"Error opening \"%s\" for reading",filename);
-		perror(str);
-		exit(1);
+	myFile = fopen(status_filename,"r");
+	if (!myFile) return SOLVER_UNSOLVED;
+	
+	while (fgets(str,1024,myFile)) {
+#ifdef USE_GUROBI
+		if (strstr(str,"Optimal solution found")) status = SOLVER_OPTIMAL;
+		if (strstr(str,"Model is infeasible") || strstr(str,"Infeasible model")) status = SOLVER_INFEASIBLE;
+#else
+		if (!strncmp(str,"Status:",7)) {
+			if (strstr(str,"INTEGER OPTIMAL")) status = SOLVER_OPTIMAL;
+			else if (strstr(str,"INTEGER NON-OPTIMAL")) status = SOLVER_FEASIBLE;
+			else if (strstr(str,"INTEGER EMPTY")) status = SOLVER_INFEASIBLE;
+			break;
+		}
+#endif
 	}
 	
 	fclose(myFile);
 	
-	// generate output filename
+	return status;
+}
+
+// run the solver on an LP file, leaving the solution in <prefix>.sol (and
+// Gurobi's log in <prefix>.log).  a MIP start file and solver options (e.g.
+// "Threads=1") are passed on to Gurobi, if given.  returns how the solver
+// ended: a solver that exits with an error is SOLVER_UNSOLVED
+solver_status run_solver (const char *filename,const char *start_filename,const char *options) {
+	char str[1024],shell_command[1024],output_filename[1024],filename_prefix[1024];
+	
+	// generate output filename, and drop the previous solution, so that
+	// read_solution() can't mistake it for this one's
 	sscanf(filename,"%[^.]",filename_prefix);
 	snprintf(output_filename,1024,"%s.sol",filename_prefix);
+	remove(output_filename);
 	
-	// run the solver
 #ifdef USE_GUROBI
+	char start_option[1024] = "",log_filename[1024];
+	if (start_filename) snprintf(start_option,1024,"InputFile=%s ",start_filename);
+	snprintf(log_filename,1024,"%s.log",filename_prefix);
+	remove(log_filename);
+	
 	snprintf(shell_command,1024,"GUROBI_PATH=\"%s\" LD_LIBRARY_PATH=\"%s/lib\" "
-								"%s/gurobi_cl ResultFile=%s %s",
+								"%s/gurobi_cl ResultFile=%s LogFile=%s %s%s%s%s",
 								GUROBI_PATH,GUROBI_PATH,GUROBI_PATH,
-								output_filename,filename);
+								output_filename,log_filename,options ? options : "",options ? " " : "",start_option,filename);
 #else
 	snprintf(shell_command,1024,"glpsol --binarize --tmlim 36000 --lp %s -o %s",filename,output_filename);
 #endif
-	ret = system(shell_command);
-	if (ret==-1) {
+	int exit_status = system(shell_command);
+	if (exit_status==-1) {
 		snprintf(str,1024,"Error running \"%s\"",shell_command);
 		perror(str);
 		exit(1);
 	}
+	if (!WIFEXITED(exit_status) || WEXITSTATUS(exit_status)) {
+		fprintf(stderr,"ERROR: \"%s\" failed (status %d)\n",shell_command,exit_status);
+		return SOLVER_UNSOLVED;
+	}
 	
-	// read the output (assuming for now that it is solvable
-	// TODO: check for "unsolvable" output
 #ifdef USE_GUROBI
-	snprintf(shell_command,1024,"awk '$1 ~ /n_[0-9]+_c_[0-9]+/ {if ($2==1) print $1}' %s",output_filename);
+	// Gurobi only writes a solution if it found one, e.g. before a time limit
+	solver_status status = read_solver_status(log_filename);
+	if (status == SOLVER_UNSOLVED && !access(output_filename,R_OK)) status = SOLVER_FEASIBLE;
+	
+	return status;
 #else
-	snprintf(shell_command,1024,"awk '$2 ~ /n_[0-9]+_c_[0-9]+/ {if ($4==1) print $2}' %s",output_filename);
+	return read_solver_status(output_filename);
+#endif
+}
+
+// read the solution that run_solver() left for an LP file, as the start
+// cycle of each node id.  returns the number of nodes, 0 if there is no
+// solution
+int read_solution (const char *filename,int **ids,int **cycles) {
+	FILE *myFile;
+	char str[1024],shell_command[1024],output_filename[1024],filename_prefix[1024];
+	int id,cycle;
+	
+	sscanf(filename,"%[^.]",filename_prefix);
+	snprintf(output_filename,1024,"%s.sol",filename_prefix);
+	
+	// start time variables s_<id> are turned into the same n_<id>_c_<cycle>
+	// form as the time-indexed ones
+#ifdef USE_GUROBI
+	snprintf(shell_command,1024,"awk '$1 ~ /n_[0-9]+_c_[0-9]+/ {if ($2==1) print $1} "
+								"$1 ~ /^s_[0-9]+$/ {printf \"n_%%s_c_%%d\\n\",substr($1,3),$2+0.5}' %s 2>/dev/null",output_filename);
+#else
+	snprintf(shell_command,1024,"awk '$2 ~ /n_[0-9]+_c_[0-9]+/ {if ($4==1) print $2} "
+								"$2 ~ /^s_[0-9]+$/ {printf \"n_%%s_c_%%d\\n\",substr($2,3),$4+0.5}' %s 2>/dev/null",output_filename);
 #endif
 	myFile = popen(shell_command,"r");
 	if (!myFile) {
@@ -402,22 +1037,93 @@ int solve_schedule (node **layers,
 		exit(1);
 	}
 	
-	// apply the solution
-	while (!feof(myFile)) {
-		argstype myargs;
-		
-		fscanf(myFile,"%s",str);
+	int count=0,max_count=1024;
+	*ids = (int *)malloc(sizeof(int)*max_count);
+	*cycles = (int *)malloc(sizeof(int)*max_count);
+	
+	while (fscanf(myFile,"%s",str)==1) {
 		//printf("read: \"%s\"\n",str);
-		sscanf(str,"n_%d_c_%d",&myargs.id,&myargs.cycle);
+		if (sscanf(str,"n_%d_c_%d",&id,&cycle)!=2) continue;
 		
-		traverse_dag (layers,
-			  num_layers,
-			  num_inputs,
-			  num_outputs,
-			  (void *)&myargs,
-			  apply_schedule,
-			  FROM_START);
+		if (count == max_count) {
+			max_count *= 2;
+			*ids = (int *)realloc(*ids,sizeof(int)*max_count);
+			*cycles = (int *)realloc(*cycles,sizeof(int)*max_count);
+		}
+		(*ids)[count] = id;
+		(*cycles)[count] = cycle;
+		count++;
+	}
+	
+	pclose(myFile);
+	
+	return count;
+}
+
+// solve an LP file written by generate_ilp_file() and apply the solution
+// to the DAG.  returns the latency, SCHEDULE_INFEASIBLE if the solver
+// proved there is no schedule, or SCHEDULE_UNSOLVED if it gave no answer.
+// schedule_status tells whether the latency is proven optimal
+int solve_schedule (node **layers,
+						int num_layers,
+						int num_inputs,
+						int num_outputs,
+						char *filename) {
+
+	return solve_schedule_status(layers,num_layers,num_inputs,num_outputs,filename,&schedule_status);
+}
+
+// solve_schedule() for concurrent callers: the status goes to the caller's
+// variable instead of schedule_status
+int solve_schedule_status (node **layers,
+						int num_layers,
+						int num_inputs,
+						int num_outputs,
+						char *filename,
+						solver_status *status) {
+
+	FILE *myFile;
+	char str[1024],filename_prefix[1024],start_filename[1024];
+	
+	// make sure we can open the LP file
+	myFile = fopen(filename,"r+");
+	if (!myFile) {
+		snprintf(str,1024,"Error opening \"%s\" for reading",filename);
+		perror(str);
+		exit(1);
+	}
+	
+	fclose(myFile);
+	
+	// run the solver
+#ifdef USE_GUROBI
+	// a schedule already in the DAG (e.g. from heuristic_schedule()) is
+	// passed on as the MIP start
+	int has_start = layers[num_layers]->scheduled_cycle >= 0;
+	if (has_start) {
+		sscanf(filename,"%[^.]",filename_prefix);
+		snprintf(start_filename,1024,"%s.mst",filename_prefix);
+		write_mip_start(layers,num_layers,start_filename);
 	}
+	*status = run_solver(filename,has_start ? start_filename : NULL,NULL);
+#else
+	*status = run_solver(filename,NULL,NULL);
+#endif
+	
+	// read the output and apply it in one pass over the id index
+	dag *mydag = layers[0]->graph;
+	int *ids,*cycles;
+	int count = read_solution(filename,&ids,&cycles);
+	
+	apply_solution(mydag,ids,cycles,count);
+	free(ids);
+	free(cycles);
+	
+	if (!count) {
+		if (*status != SOLVER_INFEASIBLE) *status = SOLVER_UNSOLVED;
+		return *status == SOLVER_INFEASIBLE ? SCHEDULE_INFEASIBLE : SCHEDULE_UNSOLVED;
+	}
+	if (*status != SOLVER_OPTIMAL) *status = SOLVER_FEASIBLE;
 	
 	// find schedule latency
 	int max_latency=0;
@@ -425,22 +1131,143 @@ int solve_schedule (node **layers,
 		if (mynode->scheduled_cycle > max_latency) max_latency = mynode->scheduled_cycle;
 	}
 	
-	fclose(myFile);
-	
 	return max_latency;
 }
 
-void incr_utilization (node *mynode,void *args) {
-	argstype *myargs = (argstype *)args;
+// solve for the minimum latency with the smallest windows that hold it.
+// the output's deadline starts at the latency's lower bound (the critical
+// path, and the cycles the units need for all operations) and is widened,
+// in growing steps, each time the solver proves the ILP infeasible.  a
+// feasible ILP holds the optimum already, so the first one ends the search.
+// upper_bound is the latency of a schedule held by the nodes (e.g. from
+// heuristic_schedule(), which is run if it's -1), kept if no ILP below it
+// is feasible, or if the solver gives no answer.  schedule_status tells
+// whether the latency returned is proven optimal
+int solve_adaptive (node **layers,
+						int num_layers,
+						int num_inputs,
+						int num_outputs,
+						char *filename,
+						int upper_bound) {
+	
+	dag *mydag = layers[0]->graph;
+	node *final = layers[num_layers];
+	int num_adds=0,num_mults=0;
+	
+	for (int i=0;i<mydag->num_nodes;i++) {
+		if (mydag->nodes[i].type == ADD) num_adds++;
+		if (mydag->nodes[i].type == MULT) num_mults++;
+	}
+	
+	int lower_bound = final->asap_cycle;
+	if (unit_latency_bound(num_adds,ADD,schedule_adders) > lower_bound) lower_bound = unit_latency_bound(num_adds,ADD,schedule_adders);
+	if (unit_latency_bound(num_mults,MULT,schedule_multipliers) > lower_bound) lower_bound = unit_latency_bound(num_mults,MULT,schedule_multipliers);
+	
+	if (upper_bound < 0) upper_bound = heuristic_schedule(layers,num_layers,num_inputs,num_outputs);
 	
-	if (!mynode->flag) {
-		if ((mynode->type == ADD) || (mynode->type == ADDBIAS))
-			myargs->add_scheduled_utilization[mynode->scheduled_cycle]++;
-		else if (mynode->type == MULT)
-			myargs->mult_scheduled_utilization[mynode->scheduled_cycle]++;
+	for (int deadline=lower_bound,step=1;deadline<upper_bound;step*=2) {
+		int latency;
 		
-		mynode->flag=1;
+		set_slack(layers,num_layers,num_inputs,deadline - final->asap_cycle);
+#ifdef USE_GLPK_API
+		latency = solve_schedule_glpk(layers,num_layers,num_inputs,num_outputs);
+#else
+		argstype myargs;
+		compute_functional_utilization(layers,num_layers,num_inputs,num_outputs,&myargs);
+		int num_variables = generate_ilp_file(layers,num_layers,num_inputs,num_outputs,filename,&myargs);
+		free(myargs.add_use);
+		free(myargs.mult_use);
+		
+		logmsg("Latency bound %d cycles: %d variables",deadline,num_variables);
+		latency = solve_schedule(layers,num_layers,num_inputs,num_outputs,filename);
+#endif
+		if (latency >= 0) {
+			if (schedule_status != SOLVER_OPTIMAL) logmsg("Latency bound %d cycles: %d cycles, not proven optimal",deadline,latency);
+			return latency;
+		}
+		
+		if (latency == SCHEDULE_UNSOLVED) {
+			// an unanswered bound proves nothing, so the schedule at hand
+			// may not be optimal
+			logmsg("Latency bound %d cycles: no answer from the solver, keeping %d cycles",deadline,upper_bound);
+			set_slack(layers,num_layers,num_inputs,upper_bound - final->asap_cycle);
+			schedule_status = SOLVER_FEASIBLE;
+			return upper_bound;
+		}
+		
+		logmsg("Latency bound %d cycles is infeasible",deadline);
+		if (deadline == upper_bound-1) break;
+		deadline = deadline+step < upper_bound-1 ? deadline+step : upper_bound-1;
 	}
+	
+	// the schedule at hand is optimal
+	set_slack(layers,num_layers,num_inputs,upper_bound - final->asap_cycle);
+	schedule_status = SOLVER_OPTIMAL;
+	
+	return upper_bound;
+}
+
+// build and solve the same DAGs with both ILP formulations, and compare
+// their size and solve time
+void benchmark_formulations (void) {
+	int topologies[][3] = {{10,4,1},{20,5,1},{50,10,1},{100,20,1}};
+	int num_topologies = sizeof(topologies)/sizeof(topologies[0]);
+	ilp_formulation formulations[] = {ILP_TIME_INDEXED,ILP_START_TIME};
+	const char *names[] = {"time-indexed","start-time"};
+	ilp_formulation saved = schedule_formulation;
+	
+	printf ("ILP formulations (%d adders, %d multipliers, slack %d)\n"
+	        "----------------\n",schedule_adders,schedule_multipliers,schedule_slack);
+	printf ("%20s%14s%12s%12s%12s%12s%12s\n","topology","formulation","variables","LP KB","write ms","solve ms","latency");
+	
+	for (int i=0;i<num_topologies;i++) {
+		node **layers = create_basic_network_dag(3,topologies[i],1,0);
+		argstype myargs;
+		char str[1024];
+		
+		schedule(layers,3,topologies[i][0],topologies[i][2]);
+		compute_functional_utilization(layers,3,topologies[i][0],topologies[i][2],&myargs);
+		snprintf(str,1024,"{%d,%d,%d}",topologies[i][0],topologies[i][1],topologies[i][2]);
+		
+		for (int f=0;f<2;f++) {
+			struct timespec start,written,solved;
+			struct stat st;
+			
+			schedule_formulation = formulations[f];
+			
+			// both formulations start cold: the previous one's optimum
+			// would otherwise be passed on as the MIP start
+			for (int j=0;j<layers[0]->graph->num_nodes;j++) layers[0]->graph->nodes[j].scheduled_cycle = -1;
+			
+			clock_gettime(CLOCK_MONOTONIC,&start);
+			int num_variables = generate_ilp_file(layers,3,topologies[i][0],topologies[i][2],(char *)"benchmark.lp",&myargs);
+			clock_gettime(CLOCK_MONOTONIC,&written);
+			int latency = solve_schedule(layers,3,topologies[i][0],topologies[i][2],(char *)"benchmark.lp");
+			clock_gettime(CLOCK_MONOTONIC,&solved);
+			
+			stat("benchmark.lp",&st);
+			printf ("%20s%14s%12d%12.1f%12.2f%12.2f%12d\n",str,names[f],num_variables,st.st_size/1024.0,
+					(written.tv_sec - start.tv_sec)*1e3 + (written.tv_nsec - start.tv_nsec)*1e-6,
+					(solved.tv_sec - written.tv_sec)*1e3 + (solved.tv_nsec - written.tv_nsec)*1e-6,
+					latency);
+		}
+		
+		free(myargs.add_use);
+		free(myargs.mult_use);
+		free_dag(layers[0]->graph);
+		free(layers);
+	}
+	
+	schedule_formulation = saved;
+}
+
+void incr_utilization (node *mynode,void *args) {
+	argstype *myargs = (argstype *)args;
+	
+	if ((mynode->type == ADD) || (mynode->type == ADDBIAS))
+		myargs->add_scheduled_utilization[mynode->scheduled_cycle]++;
+	else if (mynode->type == MULT)
+		myargs->mult_scheduled_utilization[mynode->scheduled_cycle]++;
 }
 
 void tabulate_functional_unit_utilization (node *layers[],int num_layers,int num_inputs,int num_outputs) {
@@ -462,15 +1289,6 @@ void tabulate_functional_unit_utilization (node *layers[],int num_layers,int num
 	argstype myargs = {.add_scheduled_utilization = adder_utilization,
 					   .mult_scheduled_utilization = multiplier_utilization};
 					   
-	// clear flags
-	traverse_dag (layers,
-			  num_layers,
-			  num_inputs,
-			  num_outputs,
-			  (void *)&myargs,
-			  clear_flags,
-			  FROM_START);
-			  
 	// count
 	traverse_dag (layers,
 			  num_layers,
@@ -495,9 +1313,9 @@ void tabulate_functional_unit_utilization (node *layers[],int num_layers,int num
 		total_mults += multiplier_utilization[i];
 	}
 	
-	int add_slots = max_cycle*NUM_ADDERS;
+	int add_slots = max_cycle*schedule_adders;
 	printf ("total adds = %d, total slots %d, utilization = %0.0f%%\n",total_adds,add_slots,(float)total_adds/(float)add_slots*100.f);
-	int mult_slots = max_cycle*NUM_MULTIPLIERS;
+	int mult_slots = max_cycle*schedule_multipliers;
 	printf ("total mults = %d, total slots %d, utilization = %0.0f%%\n",total_mults,mult_slots,(float)total_mults/(float)mult_slots*100.f);
 
 	free(adder_utilization);
@@ -507,51 +1325,52 @@ void tabulate_functional_unit_utilization (node *layers[],int num_layers,int num
 void printinst (node *mynode,void *myargs) {
 	func_cycle *myarg = (func_cycle *)myargs;
 	
-	if (!mynode->flag) {
-		
-		if ((mynode->scheduled_cycle==myarg->cycle) && (mynode->type==myarg->type)) {
-			char str[1024];
-			if (mynode->type==ADD) {
-				snprintf(str,1024,"%s %d %d %d",NODETYPE(mynode->type),
-												mynode->id,
-												mynode->in_edges->edge->id,
-												mynode->in_edges->next->edge->id);
-												
-			} else if (mynode->type==MULT) {
-				snprintf(str,1024,"%s %d %d coeff",NODETYPE(mynode->type),
-												mynode->id,
-												mynode->in_edges->edge->id);
-												
-			} else if (mynode->type==ADDBIAS) {
-				snprintf(str,1024,"%s %d %d bias",NODETYPE(mynode->type),
-												mynode->id,
-												mynode->in_edges->edge->id);
-												
-			} else if (mynode->type==INPUT) {
-				snprintf(str,1024,"load %d",mynode->id);
-			} else if (mynode->type==OUTPUT) {
-				snprintf(str,1024,"store %d",mynode->in_edges->edge->id);
-			}
-			printf ("\"%s\",",str);
-			myarg->found++;
+	if ((mynode->scheduled_cycle==myarg->cycle) && (mynode->type==myarg->type)) {
+		char str[1024];
+		if (mynode->type==ADD) {
+			snprintf(str,1024,"%s %d %d %d",NODETYPE(mynode->type),
+											mynode->id,
+											IN_NODE(mynode,0)->id,
+											IN_NODE(mynode,1)->id);
+											
+		} else if (mynode->type==MULT) {
+			snprintf(str,1024,"%s %d %d coeff",NODETYPE(mynode->type),
+											mynode->id,
+											IN_NODE(mynode,0)->id);
+											
+		} else if (mynode->type==ADDBIAS) {
+			snprintf(str,1024,"%s %d %d bias",NODETYPE(mynode->type),
+											mynode->id,
+											IN_NODE(mynode,0)->id);
+											
+		} else if (mynode->type==INPUT) {
+			snprintf(str,1024,"load %d",mynode->id);
+		} else if (mynode->type==OUTPUT) {
+			snprintf(str,1024,"store %d",IN_NODE(mynode,0)->id);
 		}
-	
-		mynode->flag=1;
+		printf ("\"%s\",",str);
+		myarg->found++;
 	}
 }
 
+// print each cycle's instructions in the column of the unit instance they
+// are bound to
 void tabulate_schedule_by_cycle (node *layers[],int num_layers,int num_inputs,int num_outputs) {
 	int num_cycles = layers[num_layers]->scheduled_cycle;
+	dag *mydag = layers[0]->graph;
+	binding *mybinding = bind_schedule(mydag,schedule_adders,schedule_multipliers);
+	int num_units = mybinding->num_adders + mybinding->num_multipliers;
+	node_idx *row = (node_idx *)malloc(sizeof(node_idx)*(num_units ? num_units : 1));
 	func_cycle myarg;
 	
 	// print table headers
 	printf ("\"%s\",","cycle");
-	for (int i=0;i<NUM_ADDERS;i++) {
+	for (int i=0;i<mybinding->num_adders;i++) {
 		char str[1024];
 		snprintf(str,1024,"\"adder%d\",",i);
 		printf("%s",str);
 	}
-	for (int i=0;i<NUM_MULTIPLIERS;i++) {
+	for (int i=0;i<mybinding->num_multipliers;i++) {
 		char str[1024];
 		snprintf(str,1024,"\"mult%d\",",i);
 		printf("%s",str);
@@ -559,60 +1378,477 @@ void tabulate_schedule_by_cycle (node *layers[],int num_layers,int num_inputs,in
 	printf ("\n");
 	for (int i=0;i<num_cycles;i++) {
 		printf ("\"%d\",",i);
+		
+		for (int j=0;j<num_units;j++) row[j] = NO_NODE;
+		for (int j=0;j<mydag->num_nodes;j++) {
+			node *mynode = &mydag->nodes[j];
+			
+			if (mynode->scheduled_cycle != i || mybinding->unit[j] < 0) continue;
+			row[(mynode->type == MULT ? mybinding->num_adders : 0) + mybinding->unit[j]] = j;
+		}
+		
+		for (int j=0;j<num_units;j++) {
+			if (row[j] == NO_NODE) {
+				printf("\"%s\",","");
+				continue;
+			}
+			
+			myarg.cycle=i;
+			myarg.type=mydag->nodes[row[j]].type;
+			myarg.found=0;
+			printinst(&mydag->nodes[row[j]],(void *)&myarg);
+		}
+		
+		printf ("\n");
+	}
 	
-		myarg.cycle=i;
-		myarg.type=ADD;
-		myarg.found=0;
+	free(row);
+	free_binding(mybinding);
+}
+
+// binary min-heap of (key,node) pairs packed into one 64-bit value, so
+// equal keys are broken by node index
+typedef struct {
+	int64_t *items;
+	int size;
+} node_heap;
+
+#define HEAP_ITEM(key,n)	(((int64_t)(key) << 32) | (int64_t)(n))
+#define HEAP_KEY(item)		((int)((item) >> 32))
+#define HEAP_NODE(item)		((node_idx)((item) & 0xffffffff))
+
+static void heap_push (node_heap *h,int key,node_idx n) {
+	int64_t item = HEAP_ITEM(key,n);
+	int i = h->size++;
 	
-		// clear flags
-		traverse_dag (layers,
-				  num_layers,
-				  num_inputs,
-				  num_outputs,
-				  (void *)&myarg,
-				  clear_flags,
-				  FROM_START);
-				  
-		// count
-		traverse_dag (layers,
-				  num_layers,
-				  num_inputs,
-				  num_outputs,
-				  (void *)&myarg,
-				  printinst,
-				  FROM_START);
+	while (i && h->items[(i-1)/2] > item) {
+		h->items[i] = h->items[(i-1)/2];
+		i = (i-1)/2;
+	}
+	h->items[i] = item;
+}
+
+static int64_t heap_pop (node_heap *h) {
+	int64_t top = h->items[0];
+	int64_t last = h->items[--h->size];
+	int i=0;
+	
+	for (;;) {
+		int child = 2*i+1;
+		if (child >= h->size) break;
+		if (child+1 < h->size && h->items[child+1] < h->items[child]) child++;
+		if (last <= h->items[child]) break;
+		h->items[i] = h->items[child];
+		i = child;
+	}
+	if (h->size) h->items[i] = last;
+	
+	return top;
+}
+
+// cycles that num_units units of a type are busy with num_ops operations
+int busy_cycles (int num_ops,node_type type,int num_units) {
+	return (num_ops*OCCUPANCY(type)+num_units-1)/num_units;
+}
+
+// lower bound on the latency from the units' work: the units are busy for
+// busy_cycles(), the last operation starts no more than its occupancy
+// before they're done, and the output follows it
+int unit_latency_bound (int num_ops,node_type type,int num_units) {
+	return num_ops ? busy_cycles(num_ops,type,num_units) - OCCUPANCY(type) + 1 : 0;
+}
+
+// whether a unit of the type is free for an operation starting in the
+// cycle, given the units busy in each slot of the interval ii (or in each
+// cycle, if ii is 0).  use must reach OCCUPANCY() cycles past the start
+int unit_available (const int *use,node_type type,int ii,int cycle,int num_units) {
+	for (int k=0;k<OCCUPIED_SLOTS(type,ii);k++) {
+		int slot = ii ? (cycle+k) % ii : cycle+k;
+		if (use[slot] + SLOT_WEIGHT(type,ii,k) > num_units) return 0;
+	}
+	
+	return 1;
+}
+
+// add (inc 1) or remove (-1) the occupancy of an operation starting in the
+// cycle to the units busy per slot (see unit_available())
+void occupy_unit (int *use,node_type type,int ii,int cycle,int inc) {
+	for (int k=0;k<OCCUPIED_SLOTS(type,ii);k++) {
+		int slot = ii ? (cycle+k) % ii : cycle+k;
+		use[slot] += inc*SLOT_WEIGHT(type,ii,k);
+	}
+}
+
+// start a node in the given cycle and release the successors whose
+// operands are now all scheduled
+static void list_issue (node *mynode,int cycle,int *start,int *pending,int *release,node_heap *waiting) {
+	int latency = NODE_LATENCY(mynode);
+	
+	start[mynode->index] = cycle;
+	
+	for (int i=0;i<NUM_OUT_EDGES(mynode);i++) {
+		node_idx succ = OUT_EDGE(mynode,i).node_index;
+		if (cycle + latency > release[succ]) release[succ] = cycle + latency;
+		if (!--pending[succ]) heap_push(waiting,release[succ],succ);
+	}
+}
+
+// the most units busy in any cycle that an operation issued in the given
+// cycle would occupy: those issued to in the last OCCUPANCY() cycles (by
+// cycle modulo the occupancy), and those reserved up to the horizon
+static int list_busy (const int *issued,int occupancy,const int *reserved,int horizon,int cycle) {
+	int busy=0;
+	
+	for (int t=cycle;t<cycle+occupancy;t++) {
+		int count = t < horizon ? reserved[t] : 0;
+		for (int c=t-occupancy+1;c<=cycle;c++) if (c >= 0) count += issued[c % occupancy];
+		if (count > busy) busy = count;
+	}
+	
+	return busy;
+}
+
+// resource-constrained list scheduling: in every cycle, issue ADD and MULT
+// nodes whose operands are ready to the num_adders and num_multipliers units
+// not still busy (see OCCUPANCY()), lowest priority value (usually the ALAP)
+// first.  as in generate_ilp_file(), only ADD and MULT nodes compete for
+// units.  the DAG itself isn't modified, so several schedules of one DAG can
+// be computed concurrently.  if given, earliest holds a release cycle for
+// each node, and the nodes marked in fixed start exactly there: their units
+// are reserved up front, so no node issued before them can keep them busy.
+// fixed nodes must have no predecessors.  returns the start cycle of the
+// last node
+int list_schedule_released (dag *mydag,const int *priority,const int *earliest,const int *fixed,int num_adders,int num_multipliers,int *start) {
+	int n = mydag->num_nodes;
+	int *pending = (int *)malloc(sizeof(int)*(n ? n : 1));
+	int *release = (int *)malloc(sizeof(int)*(n ? n : 1));
+	node_heap waiting,ready_add,ready_mult;
+	int scheduled=0,last_start=0,horizon=0;
+	
+	// units issued to in each of the last OCCUPANCY() cycles, by cycle
+	// modulo the occupancy
+	int occupancy[2] = {OCCUPANCY(ADD),OCCUPANCY(MULT)};
+	int *issued[2];
+	for (int k=0;k<2;k++) issued[k] = (int *)calloc(occupancy[k],sizeof(int));
+	
+	// units held by the fixed nodes, by cycle
+	for (int i=0;fixed && i<n;i++) {
+		node_type type = mydag->nodes[i].type;
+		if (fixed[i] && (type == ADD || type == MULT) && earliest[i] + OCCUPANCY(type) > horizon)
+			horizon = earliest[i] + OCCUPANCY(type);
+	}
+	int *reserved[2];
+	for (int k=0;k<2;k++) reserved[k] = (int *)calloc(horizon ? horizon : 1,sizeof(int));
+	for (int i=0;fixed && i<n;i++) {
+		node_type type = mydag->nodes[i].type;
+		if (!fixed[i] || (type != ADD && type != MULT)) continue;
+		for (int c=earliest[i];c<earliest[i]+OCCUPANCY(type);c++) reserved[type == ADD ? 0 : 1][c]++;
+	}
+	
+	topological_order(mydag);
+	
+	waiting.items = (int64_t *)malloc(sizeof(int64_t)*(n ? n : 1));
+	ready_add.items = (int64_t *)malloc(sizeof(int64_t)*(n ? n : 1));
+	ready_mult.items = (int64_t *)malloc(sizeof(int64_t)*(n ? n : 1));
+	waiting.size = ready_add.size = ready_mult.size = 0;
+	
+	for (int i=0;i<n;i++) {
+		pending[i] = NUM_IN_EDGES(&mydag->nodes[i]);
+		release[i] = earliest ? earliest[i] : 0;
+		if (!pending[i]) heap_push(&waiting,release[i],i);
+	}
+	
+	for (int cycle=0,previous=-1;scheduled<n;cycle++) {
+		int units_left[2] = {num_adders,num_multipliers};
+		node_heap *ready[2] = {&ready_add,&ready_mult};
+		int progress=1;
 		
-		int blank_slots = NUM_ADDERS-myarg.found;
-		for (int j=0;j<blank_slots;j++) {
-			printf("\"%s\",","");
+		// units issued to OCCUPANCY() cycles ago (or before the idle cycles
+		// skipped since) are free again.  a node issued now must also leave
+		// the reserved units free for its whole occupancy
+		for (int k=0;k<2;k++) {
+			for (int c=previous+1;c<=cycle && c<=previous+occupancy[k];c++) issued[k][c % occupancy[k]] = 0;
+			units_left[k] -= list_busy(issued[k],occupancy[k],reserved[k],horizon,cycle);
 		}
-				  
-		myarg.type=MULT;
-		myarg.found=0;
+		
+		// zero-latency nodes can release successors in the same cycle, so
+		// repeat until nothing more can be issued
+		while (progress) {
+			progress=0;
+			
+			while (waiting.size && HEAP_KEY(waiting.items[0]) <= cycle) {
+				node *mynode = &mydag->nodes[HEAP_NODE(heap_pop(&waiting))];
+				
+				if (fixed && fixed[mynode->index]) {
+					// its unit is reserved already
+					list_issue(mynode,earliest[mynode->index],start,pending,release,&waiting);
+					last_start = cycle;
+					scheduled++;
+				}
+				else if (mynode->type == ADD) heap_push(&ready_add,priority[mynode->index],mynode->index);
+				else if (mynode->type == MULT) heap_push(&ready_mult,priority[mynode->index],mynode->index);
+				else {
+					// unconstrained, so issue as soon as the operands are ready
+					list_issue(mynode,cycle,start,pending,release,&waiting);
+					last_start = cycle;
+					scheduled++;
+				}
+			}
+			
+			for (int k=0;k<2;k++) {
+				while (units_left[k] > 0 && ready[k]->size) {
+					list_issue(&mydag->nodes[HEAP_NODE(heap_pop(ready[k]))],cycle,start,pending,release,&waiting);
+					units_left[k]--;
+					issued[k][cycle % occupancy[k]]++;
+					last_start = cycle;
+					scheduled++;
+					progress=1;
+				}
+			}
+			
+			if (waiting.size && HEAP_KEY(waiting.items[0]) <= cycle) progress=1;
+		}
+		
+		previous = cycle;
+		
+		// skip idle cycles
+		if (!ready_add.size && !ready_mult.size && waiting.size && HEAP_KEY(waiting.items[0]) > cycle+1)
+			cycle = HEAP_KEY(waiting.items[0])-1;
+	}
 	
-		// clear flags
-		traverse_dag (layers,
-				  num_layers,
-				  num_inputs,
-				  num_outputs,
-				  (void *)&myarg,
-				  clear_flags,
-				  FROM_START);
-				  
-		// count
-		traverse_dag (layers,
-				  num_layers,
-				  num_inputs,
-				  num_outputs,
-				  (void *)&myarg,
-				  printinst,
-				  FROM_START);
-				  
-		blank_slots = NUM_ADDERS-myarg.found;
-		for (int j=0;j<blank_slots;j++) {
-			printf("\"%s\",","");
+	free(waiting.items);
+	free(ready_add.items);
+	free(ready_mult.items);
+	free(pending);
+	free(release);
+	free(issued[0]);
+	free(issued[1]);
+	free(reserved[0]);
+	free(reserved[1]);
+	
+	return last_start;
+}
+
+int list_schedule (dag *mydag,const int *priority,int num_adders,int num_multipliers,int *start) {
+	return list_schedule_released(mydag,priority,NULL,NULL,num_adders,num_multipliers,start);
+}
+
+// grow the per-cycle distribution graphs and unit usage of
+// force_directed_schedule() to hold at least the given number of cycles
+static void fds_grow (int *horizon,int cycles,double *dg[2],int *used[2]) {
+	if (cycles <= *horizon) return;
+	
+	int size = *horizon;
+	while (size < cycles) size *= 2;
+	
+	for (int k=0;k<2;k++) {
+		dg[k] = (double *)realloc(dg[k],sizeof(double)*size);
+		used[k] = (int *)realloc(used[k],sizeof(int)*size);
+		for (int c=*horizon;c<size;c++) {
+			dg[k][c] = 0.0;
+			used[k][c] = 0;
 		}
+	}
+	*horizon = size;
+}
 
-		printf ("\n");
+#define FDS_UNIT(type)	((type) == ADD ? 0 : (type) == MULT ? 1 : -1)
+
+// force-directed scheduling under resource constraints.  every ADD and MULT
+// node is spread uniformly over its asap..alap window to form a distribution
+// graph per unit type.  in topological order, each node is then fixed in the
+// cycle with a unit free for its whole occupancy and the lowest force: the
+// distribution graph at that cycle against its window's average (self
+// force), plus the same measure for the successor windows that the choice
+// cuts short.  nodes that find no free unit up to their ALAP go to the
+// first free cycle after it.  the DAG's timing must be computed.  returns
+// the start cycle of the last node
+int force_directed_schedule (dag *mydag,int num_adders,int num_multipliers,int *start) {
+	int n = mydag->num_nodes;
+	node_idx *order = topological_order(mydag);
+	int capacity[2] = {num_adders,num_multipliers};
+	double *dg[2] = {NULL,NULL};
+	int *used[2] = {NULL,NULL};
+	int horizon=1,last_start=0;
+	double *prefix = NULL,*force = NULL;
+	int prefix_size=0,force_size=0;
+	
+	for (int i=0;i<n;i++) fds_grow(&horizon,mydag->nodes[i].alap_cycle+OCCUPANCY(mydag->nodes[i].type)+1,dg,used);
+	
+	for (int i=0;i<n;i++) {
+		node *mynode = &mydag->nodes[i];
+		int k = FDS_UNIT(mynode->type);
+		
+		if (k<0) continue;
+		for (int c=mynode->asap_cycle;c<=mynode->alap_cycle;c++)
+			dg[k][c] += 1.0/(mynode->alap_cycle - mynode->asap_cycle + 1);
+	}
+	
+	for (int i=0;i<n;i++) {
+		node *mynode = &mydag->nodes[order[i]];
+		int k = FDS_UNIT(mynode->type);
+		int latency = NODE_LATENCY(mynode);
+		int earliest=0,best=-1;
+		
+		for (int j=0;j<NUM_IN_EDGES(mynode);j++) {
+			node *pred = IN_NODE(mynode,j);
+			int ready = start[pred->index] + NODE_LATENCY(pred);
+			if (ready > earliest) earliest = ready;
+		}
+		
+		if (k<0) {
+			// unconstrained, so start as soon as the operands are ready
+			start[mynode->index] = earliest;
+			if (earliest > last_start) last_start = earliest;
+			continue;
+		}
+		
+		int latest = mynode->alap_cycle < earliest ? earliest : mynode->alap_cycle;
+		int width = mynode->alap_cycle - mynode->asap_cycle + 1;
+		double average=0.0,best_force=0.0;
+		
+		fds_grow(&horizon,latest+OCCUPANCY(mynode->type)+1,dg,used);
+		for (int c=mynode->asap_cycle;c<=mynode->alap_cycle;c++) average += dg[k][c];
+		average /= width;
+		
+		// self force of every candidate cycle
+		if (latest-earliest+1 > force_size) {
+			force_size = 2*(latest-earliest+1);
+			force = (double *)realloc(force,sizeof(double)*force_size);
+		}
+		for (int c=earliest;c<=latest;c++) force[c-earliest] = dg[k][c] - average;
+		
+		// plus that of the successors whose window now starts later
+		for (int j=0;j<NUM_OUT_EDGES(mynode);j++) {
+			node *succ = OUT_NODE(mynode,j);
+			int ks = FDS_UNIT(succ->type);
+			int succ_width = succ->alap_cycle - succ->asap_cycle + 1;
+			
+			if (ks<0) continue;
+			
+			if (succ_width+1 > prefix_size) {
+				prefix_size = 2*(succ_width+1);
+				prefix = (double *)realloc(prefix,sizeof(double)*prefix_size);
+			}
+			prefix[0] = 0.0;
+			for (int m=0;m<succ_width;m++) prefix[m+1] = prefix[m] + dg[ks][succ->asap_cycle+m];
+			
+			for (int c=earliest;c<=latest;c++) {
+				int cut = c + latency - succ->asap_cycle;
+				
+				if (cut <= 0 || cut >= succ_width) continue;
+				force[c-earliest] += (prefix[succ_width]-prefix[cut])/(succ_width-cut) - prefix[succ_width]/succ_width;
+			}
+		}
+		
+		for (int c=earliest;c<=latest;c++) {
+			if (!unit_available(used[k],mynode->type,0,c,capacity[k])) continue;
+			
+			if (best<0 || force[c-earliest] < best_force - 1e-9) {
+				best = c;
+				best_force = force[c-earliest];
+			}
+		}
+		
+		// no free unit inside the window
+		if (best<0) {
+			best = latest+1;
+			for (;;) {
+				fds_grow(&horizon,best+OCCUPANCY(mynode->type)+1,dg,used);
+				if (unit_available(used[k],mynode->type,0,best,capacity[k])) break;
+				best++;
+			}
+		}
+		
+		// the node's probability collapses onto the chosen cycle
+		for (int c=mynode->asap_cycle;c<=mynode->alap_cycle;c++) dg[k][c] -= 1.0/width;
+		dg[k][best] += 1.0;
+		occupy_unit(used[k],mynode->type,0,best,1);
+		
+		start[mynode->index] = best;
+		if (best > last_start) last_start = best;
+	}
+	
+	for (int k=0;k<2;k++) {
+		free(dg[k]);
+		free(used[k]);
+	}
+	free(prefix);
+	free(force);
+	
+	return last_start;
+}
+
+// schedule the DAG with both heuristics (list scheduling by ALAP, and
+// force-directed scheduling), keep the shorter schedule in the nodes'
+// scheduled cycles and return its latency.  with a register objective, the
+// schedule's lifetimes are shortened first.  the DAG's timing must be
+// computed
+int heuristic_schedule (node *layers[],int num_layers,int num_inputs,int num_outputs) {
+	dag *mydag = layers[0]->graph;
+	int n = mydag->num_nodes;
+	int *priority = (int *)malloc(sizeof(int)*(n ? n : 1));
+	int *list_start = (int *)malloc(sizeof(int)*(n ? n : 1));
+	int *fds_start = (int *)malloc(sizeof(int)*(n ? n : 1));
+	node_idx final = layers[num_layers]->index;
+	
+	for (int i=0;i<n;i++) priority[i] = mydag->nodes[i].alap_cycle;
+	
+	list_schedule(mydag,priority,schedule_adders,schedule_multipliers,list_start);
+	force_directed_schedule(mydag,schedule_adders,schedule_multipliers,fds_start);
+	
+	logmsg("Heuristic schedule latency: list %d cycles, force-directed %d cycles",list_start[final],fds_start[final]);
+	
+	int *best = fds_start[final] < list_start[final] ? fds_start : list_start;
+	int latency = best[final];
+	
+	// hold the values no longer than needed
+	if (schedule_registers != REGISTERS_NONE) {
+		int peak;
+		long before,after;
+		
+		register_pressure(mydag,best,&peak,&before);
+		after = reduce_register_pressure(mydag,schedule_adders,schedule_multipliers,best);
+		logmsg("Heuristic register pressure: %ld register-cycles before, %ld after rescheduling",before,after);
 	}
+	
+	for (int i=0;i<n;i++) mydag->nodes[i].scheduled_cycle = best[i];
+	
+	free(priority);
+	free(list_start);
+	free(fds_start);
+	
+	return latency;
+}
+
+// write the nodes' current schedule as a MIP start for the ILP written by
+// generate_ilp_file() (in Gurobi's MST format).  nodes scheduled outside of
+// their window are left out, and the solver completes the start
+void write_mip_start (node *layers[],int num_layers,char *filename) {
+	dag *mydag = layers[0]->graph;
+	FILE *myFile;
+	char str[1024];
+	
+	myFile=fopen(filename,"w+");
+	if (!myFile) {
+		snprintf(str,1024,"ERROR: opening \"%s\" for write",filename);
+		perror(str);
+		exit(1);
+	}
+	
+	for (int i=0;i<mydag->num_nodes;i++) {
+		node *mynode = &mydag->nodes[i];
+		int cycle = mynode->scheduled_cycle;
+		
+		if (cycle < mynode->asap_cycle || cycle > mynode->alap_cycle) continue;
+		
+		if (schedule_formulation == ILP_START_TIME) {
+			fprintf(myFile,"s_%d %d\n",mynode->id,cycle);
+		} else {
+			for (int c=mynode->asap_cycle;c<=mynode->alap_cycle;c++)
+				fprintf(myFile,"n_%d_c_%d %d\n",mynode->id,c,c==cycle);
+		}
+	}
+	
+	fclose(myFile);
 }
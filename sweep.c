@@ -0,0 +1,568 @@
+#include "netscheduler.h"
+
+// design-space sweep: every topology in the grid is built once, and the
+// cross product of the other parameters is evaluated on it by a pool of
+// threads.  each point gets its own timing windows and a list schedule, so
+// the shared DAG is only read while the workers are running
+
+#define SWEEP_MAX_VALUES	64
+#define SWEEP_MAX_LAYERS	16
+
+typedef struct {
+	int num_topologies;
+	int num_layers[SWEEP_MAX_VALUES];
+	int topologies[SWEEP_MAX_VALUES][SWEEP_MAX_LAYERS];
+	int num_adders,adders[SWEEP_MAX_VALUES];
+	int num_multipliers,multipliers[SWEEP_MAX_VALUES];
+	int num_slacks,slacks[SWEEP_MAX_VALUES];
+	int num_max_iis,max_iis[SWEEP_MAX_VALUES];
+} sweep_grid;
+
+typedef struct {
+	int adders;
+	int multipliers;
+	int slack;
+	int max_ii;
+	
+	// results
+	int lower_bound;
+	int latency;
+	float add_utilization;
+	float mult_utilization;
+	int max_registers;
+	long lp_variables;
+	double ms;
+} sweep_point;
+
+typedef struct {
+	dag *mydag;
+	node_idx final_node;
+	sweep_point *points;
+	int num_points;
+	int next_point;
+	pthread_mutex_t lock;
+} sweep_job;
+
+static int parse_values (char *line,int *values,int max_values) {
+	int num_values=0;
+	
+	for (char *token = strtok(line," \t\r\n");token;token = strtok(NULL," \t\r\n")) {
+		if (num_values == max_values) {
+			fprintf(stderr,"Fatal: more than %d values on one sweep grid line.\n",max_values);
+			exit(1);
+		}
+		values[num_values++] = atoi(token);
+	}
+	
+	return num_values;
+}
+
+// the grid file has one line per parameter, a keyword followed by the values
+// to sweep ("topology" may be repeated, once per network).  parameters left
+// out keep their value from netscheduler.h
+static void read_sweep_grid (const char *filename,sweep_grid *grid) {
+	char line[4096],keyword[64],str[1024];
+	int mlp_topology[] = MLP_TOPOLOGY;
+	
+	grid->num_topologies = 0;
+	grid->num_adders = grid->num_multipliers = grid->num_slacks = grid->num_max_iis = 0;
+	
+	FILE *myFile = fopen(filename,"r");
+	if (!myFile) {
+		snprintf(str,1024,"ERROR: opening \"%s\" for read",filename);
+		perror(str);
+		exit(1);
+	}
+	
+	while (fgets(line,4096,myFile)) {
+		int offset;
+	
+		if (sscanf(line," %63s%n",keyword,&offset) != 1 || keyword[0]=='#') continue;
+	
+		if (!strcmp(keyword,"topology")) {
+			if (grid->num_topologies == SWEEP_MAX_VALUES) {
+				fprintf(stderr,"Fatal: more than %d topologies in \"%s\".\n",SWEEP_MAX_VALUES,filename);
+				exit(1);
+			}
+			int t = grid->num_topologies++;
+			grid->num_layers[t] = parse_values(line+offset,grid->topologies[t],SWEEP_MAX_LAYERS);
+			if (grid->num_layers[t] < 2) {
+				fprintf(stderr,"Fatal: a sweep topology needs at least two layers.\n");
+				exit(1);
+			}
+		} else if (!strcmp(keyword,"adders")) {
+			grid->num_adders = parse_values(line+offset,grid->adders,SWEEP_MAX_VALUES);
+		} else if (!strcmp(keyword,"multipliers")) {
+			grid->num_multipliers = parse_values(line+offset,grid->multipliers,SWEEP_MAX_VALUES);
+		} else if (!strcmp(keyword,"slack")) {
+			grid->num_slacks = parse_values(line+offset,grid->slacks,SWEEP_MAX_VALUES);
+		} else if (!strcmp(keyword,"max_ii")) {
+			grid->num_max_iis = parse_values(line+offset,grid->max_iis,SWEEP_MAX_VALUES);
+		} else {
+			fprintf(stderr,"Fatal: unknown sweep parameter \"%s\" in \"%s\".\n",keyword,filename);
+			exit(1);
+		}
+	}
+	
+	fclose(myFile);
+	
+	if (!grid->num_topologies) {
+		grid->num_topologies = 1;
+		grid->num_layers[0] = NUM_LAYERS;
+		memcpy(grid->topologies[0],mlp_topology,sizeof(mlp_topology));
+	}
+	if (!grid->num_adders) grid->adders[grid->num_adders++] = NUM_ADDERS;
+	if (!grid->num_multipliers) grid->multipliers[grid->num_multipliers++] = NUM_MULTIPLIERS;
+	if (!grid->num_slacks) grid->slacks[grid->num_slacks++] = SLACK;
+	if (!grid->num_max_iis) grid->max_iis[grid->num_max_iis++] = MAX_II;
+	
+	for (int i=0;i<grid->num_adders;i++)
+		if (grid->adders[i] < 1) {
+			fprintf(stderr,"Fatal: sweep needs at least one adder.\n");
+			exit(1);
+		}
+	for (int i=0;i<grid->num_multipliers;i++)
+		if (grid->multipliers[i] < 1) {
+			fprintf(stderr,"Fatal: sweep needs at least one multiplier.\n");
+			exit(1);
+		}
+}
+
+static void evaluate_sweep_point (dag *mydag,node_idx final_node,sweep_point *point,int *asap,int *alap,int *start) {
+	struct timespec t_start,t_end;
+	node_idx *order = mydag->topo_order;
+	int n = mydag->num_nodes;
+	
+	clock_gettime(CLOCK_MONOTONIC,&t_start);
+	
+	// ASAP/ALAP windows for this point (the same rules as schedule())
+	for (int i=0;i<n;i++) {
+		node *mynode = &mydag->nodes[order[i]];
+		int myasap = mynode->type == INPUT ? 0 : -1;
+	
+		for (int j=0;j<NUM_IN_EDGES(mynode);j++) {
+			node_idx pred = IN_EDGE(mynode,j).node_index;
+			int latency = NODE_LATENCY(&mydag->nodes[pred]);
+			if (asap[pred] + latency > myasap) myasap = asap[pred] + latency;
+		}
+		asap[order[i]] = myasap;
+	}
+	
+	alap[final_node] = asap[final_node] + point->slack;
+	for (int i=n-1;i>=0;i--) {
+		node *mynode = &mydag->nodes[order[i]];
+		int latency = NODE_LATENCY(mynode);
+	
+		if (!NUM_OUT_EDGES(mynode)) {
+			if (order[i] != final_node) alap[order[i]] = -1;
+			continue;
+		}
+	
+		int myalap = -1;
+		for (int j=0;j<NUM_OUT_EDGES(mynode);j++) {
+			int succ_alap = alap[OUT_EDGE(mynode,j).node_index] - latency;
+			if (myalap == -1 || succ_alap < myalap) myalap = succ_alap;
+		}
+		alap[order[i]] = myalap;
+	}
+	
+	point->lower_bound = asap[final_node];
+	point->lp_variables = 0;
+	for (int i=0;i<n;i++) {
+		if (mydag->nodes[i].type == INPUT) alap[i] = point->max_ii;
+		if (alap[i] >= asap[i]) point->lp_variables += alap[i]-asap[i]+1;
+	}
+	
+	// schedule with the least-slack node first
+	list_schedule(mydag,alap,point->adders,point->multipliers,start);
+	point->latency = start[final_node];
+	
+	// unit utilization over the schedule, counted like tabulate_functional_unit_utilization()
+	int adds=0,mults=0;
+	for (int i=0;i<n;i++) {
+		if (mydag->nodes[i].type == ADD || mydag->nodes[i].type == ADDBIAS) adds++;
+		else if (mydag->nodes[i].type == MULT) mults++;
+	}
+	point->add_utilization = point->latency ? 100.f*adds/((float)point->latency*point->adders) : 0.f;
+	point->mult_utilization = point->latency ? 100.f*mults/((float)point->latency*point->multipliers) : 0.f;
+	
+	// register pressure, counted like count_registers()
+	long register_cycles;
+	register_pressure(mydag,start,&point->max_registers,&register_cycles);
+	
+	clock_gettime(CLOCK_MONOTONIC,&t_end);
+	point->ms = (t_end.tv_sec - t_start.tv_sec)*1e3 + (t_end.tv_nsec - t_start.tv_nsec)*1e-6;
+}
+
+static void *sweep_worker (void *args) {
+	sweep_job *job = (sweep_job *)args;
+	int n = job->mydag->num_nodes;
+	
+	// per-thread scratch, reused across points
+	int *asap = (int *)malloc(sizeof(int)*n);
+	int *alap = (int *)malloc(sizeof(int)*n);
+	int *start = (int *)malloc(sizeof(int)*n);
+	
+	for (;;) {
+		pthread_mutex_lock(&job->lock);
+		int point = job->next_point++;
+		pthread_mutex_unlock(&job->lock);
+	
+		if (point >= job->num_points) break;
+		evaluate_sweep_point(job->mydag,job->final_node,&job->points[point],asap,alap,start);
+	}
+	
+	free(asap);
+	free(alap);
+	free(start);
+	
+	return NULL;
+}
+
+void design_sweep (const char *filename) {
+	sweep_grid grid;
+	
+	read_sweep_grid(filename,&grid);
+	
+	int num_threads = SWEEP_THREADS;
+	if (num_threads < 1) num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (num_threads < 1) num_threads = 1;
+	
+	int num_points = grid.num_adders*grid.num_multipliers*grid.num_slacks*grid.num_max_iis;
+	sweep_point *points = (sweep_point *)malloc(sizeof(sweep_point)*num_points);
+	pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t)*num_threads);
+	
+	printf ("Design-space sweep (%d points per topology, %d threads)\n"
+	        "------------------\n",num_points,num_threads);
+	printf ("%20s%8s%8s%8s%8s%8s%9s%6s%9s%9s%10s%12s%10s\n","topology","adders","mults","slack","max_ii",
+			"lower","latency","fits","add%","mult%","registers","lp vars","ms");
+	
+	for (int t=0;t<grid.num_topologies;t++) {
+		char topology[1024];
+		int length = snprintf(topology,1024,"{");
+		for (int l=0;l<grid.num_layers[t];l++)
+			length += snprintf(topology+length,1024-length,l ? ",%d" : "%d",grid.topologies[t][l]);
+		snprintf(topology+length,1024-length,"}");
+	
+		// the DAG (and its topological order) is built once per topology
+		node **layers = create_basic_network_dag(grid.num_layers[t],grid.topologies[t],1,0);
+		dag *mydag = layers[0]->graph;
+		topological_order(mydag);
+#ifdef CHAIN_OPERATIONS
+		chain_operations(mydag);
+#endif
+	
+		int p=0;
+		for (int a=0;a<grid.num_adders;a++)
+			for (int m=0;m<grid.num_multipliers;m++)
+				for (int s=0;s<grid.num_slacks;s++)
+					for (int i=0;i<grid.num_max_iis;i++,p++) {
+						points[p].adders = grid.adders[a];
+						points[p].multipliers = grid.multipliers[m];
+						points[p].slack = grid.slacks[s];
+						points[p].max_ii = grid.max_iis[i];
+					}
+	
+		sweep_job job;
+		job.mydag = mydag;
+		job.final_node = layers[grid.num_layers[t]]->index;
+		job.points = points;
+		job.num_points = num_points;
+		job.next_point = 0;
+		pthread_mutex_init(&job.lock,NULL);
+	
+		for (int i=0;i<num_threads;i++) {
+			if (pthread_create(&threads[i],NULL,sweep_worker,(void *)&job)) {
+				perror("Fatal: creating sweep thread");
+				exit(1);
+			}
+		}
+		for (int i=0;i<num_threads;i++) pthread_join(threads[i],NULL);
+	
+		pthread_mutex_destroy(&job.lock);
+	
+		for (int i=0;i<num_points;i++) {
+			sweep_point *point = &points[i];
+			// a list schedule within the slack proves the ILP for this point is feasible
+			printf ("%20s%8d%8d%8d%8d%8d%9d%6s%9.1f%9.1f%10d%12ld%10.2f\n",topology,point->adders,point->multipliers,
+					point->slack,point->max_ii,point->lower_bound,point->latency,
+					point->latency <= point->lower_bound+point->slack ? "yes" : "no",
+					point->add_utilization,point->mult_utilization,point->max_registers,
+					point->lp_variables,point->ms);
+		}
+	
+		free_dag(mydag);
+		free(layers);
+	}
+	
+	free(threads);
+	free(points);
+}
+
+// Pareto exploration: the ILP is solved for every (adders, multipliers)
+// budget of the grid, with one solver process per core.  the points are
+// handed out from the largest budget down, and every result bounds the
+// points dispatched after it: a point's optimal latency is a lower bound
+// for all budgets with fewer units and an upper bound for all budgets with
+// more, and a point the solver proved infeasible makes every smaller budget
+// infeasible.  a schedule the solver found but didn't prove optimal only
+// bounds the larger budgets, and a point the solver gave no answer for
+// bounds none
+
+typedef enum {PARETO_PENDING,PARETO_RUNNING,PARETO_OPTIMAL,PARETO_BOUNDS,PARETO_HEURISTIC,PARETO_FEASIBLE,PARETO_INFEASIBLE,PARETO_UNSOLVED} pareto_status;
+
+typedef struct {
+	int adders;
+	int multipliers;
+	
+	// results
+	pareto_status status;
+	int lower_bound;
+	int upper_bound;
+	int latency;
+	double ms;
+	
+	// solver instance
+	char lp_filename[1024];
+	char start_filename[1024];
+	int final_id;
+	pthread_t thread;
+	struct timespec started;
+} pareto_point;
+
+typedef struct {
+	pareto_point *points;
+	int num_points;
+	int running;
+	pthread_mutex_t lock;
+	pthread_cond_t done;
+} pareto_farm;
+
+typedef struct {
+	pareto_farm *farm;
+	pareto_point *point;
+} pareto_instance;
+
+static const char *pareto_status_names[] = {"pending","running","optimal","bounds","heuristic","feasible","infeasible","unsolved"};
+
+// does point a have no more units of either kind than point b?
+#define PARETO_FEWER(a,b)	((a)->adders <= (b)->adders && (a)->multipliers <= (b)->multipliers)
+
+// does the point hold a schedule?
+#define PARETO_SCHEDULED(a)	((a)->status >= PARETO_OPTIMAL && (a)->status <= PARETO_FEASIBLE)
+
+static void *pareto_worker (void *args) {
+	pareto_instance *instance = (pareto_instance *)args;
+	pareto_farm *farm = instance->farm;
+	pareto_point *point = instance->point;
+	int *ids,*cycles,latency=-1;
+	struct timespec t_end;
+	
+	// one solver thread per instance, the farm supplies the parallelism
+	solver_status status = run_solver(point->lp_filename,point->start_filename,"Threads=1");
+	
+	int count = read_solution(point->lp_filename,&ids,&cycles);
+	for (int i=0;i<count;i++) if (ids[i] == point->final_id) latency = cycles[i];
+	free(ids);
+	free(cycles);
+	
+	clock_gettime(CLOCK_MONOTONIC,&t_end);
+	
+	pthread_mutex_lock(&farm->lock);
+	if (latency >= 0 && status == SOLVER_OPTIMAL) {
+		point->latency = latency;
+		point->status = PARETO_OPTIMAL;
+	} else if (latency >= 0 && (point->upper_bound < 0 || latency < point->upper_bound)) {
+		// stopped with a schedule, not proven optimal
+		point->latency = latency;
+		point->status = PARETO_FEASIBLE;
+	} else if (point->upper_bound >= 0) {
+		// no better answer from the solver, keep the heuristic schedule
+		point->latency = point->upper_bound;
+		point->status = PARETO_HEURISTIC;
+	} else {
+		point->status = status == SOLVER_INFEASIBLE ? PARETO_INFEASIBLE : PARETO_UNSOLVED;
+	}
+	point->ms = (t_end.tv_sec - point->started.tv_sec)*1e3 + (t_end.tv_nsec - point->started.tv_nsec)*1e-6;
+	farm->running--;
+	pthread_cond_signal(&farm->done);
+	pthread_mutex_unlock(&farm->lock);
+	
+	free(instance);
+	
+	return NULL;
+}
+
+// bound a pending point with the results so far, settle it if the bounds
+// meet (or a larger budget was infeasible).  returns whether it's settled
+static int pareto_bound (pareto_farm *farm,pareto_point *point,int lower_bound) {
+	point->lower_bound = lower_bound;
+	point->upper_bound = -1;
+	
+	for (int i=0;i<farm->num_points;i++) {
+		pareto_point *other = &farm->points[i];
+		
+		if (other == point || other->status < PARETO_OPTIMAL || other->status == PARETO_UNSOLVED) continue;
+		
+		if (PARETO_FEWER(point,other)) {
+			if (other->status == PARETO_INFEASIBLE) {
+				point->status = PARETO_INFEASIBLE;
+				return 1;
+			}
+			if ((other->status == PARETO_OPTIMAL || other->status == PARETO_BOUNDS) && other->latency > point->lower_bound)
+				point->lower_bound = other->latency;
+		}
+		if (PARETO_FEWER(other,point) && PARETO_SCHEDULED(other))
+			if (point->upper_bound < 0 || other->latency < point->upper_bound) point->upper_bound = other->latency;
+	}
+	
+	return 0;
+}
+
+// explore the latency vs. units trade-off of the grid's first topology (at
+// its first slack and max_ii), and print the Pareto front
+void pareto_sweep (const char *filename) {
+	sweep_grid grid;
+	
+	read_sweep_grid(filename,&grid);
+	
+	int num_threads = PARETO_THREADS;
+	if (num_threads < 1) num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (num_threads < 1) num_threads = 1;
+	
+	int num_layers = grid.num_layers[0];
+	int *layer_sizes = grid.topologies[0];
+	node **layers = create_basic_network_dag(num_layers,layer_sizes,1,0);
+	dag *mydag = layers[0]->graph;
+	node *final = layers[num_layers];
+	int saved_adders = schedule_adders,saved_multipliers = schedule_multipliers;
+	int saved_slack = schedule_slack,saved_max_ii = schedule_max_ii;
+	
+	schedule_slack = grid.slacks[0];
+	schedule_max_ii = grid.max_iis[0];
+	schedule(layers,num_layers,layer_sizes[0],layer_sizes[num_layers-1]);
+	
+	int num_adds=0,num_mults=0;
+	for (int i=0;i<mydag->num_nodes;i++) {
+		if (mydag->nodes[i].type == ADD) num_adds++;
+		if (mydag->nodes[i].type == MULT) num_mults++;
+	}
+	
+	// largest budgets first
+	pareto_farm farm;
+	farm.num_points = grid.num_adders*grid.num_multipliers;
+	farm.points = (pareto_point *)calloc(farm.num_points,sizeof(pareto_point));
+	farm.running = 0;
+	pthread_mutex_init(&farm.lock,NULL);
+	pthread_cond_init(&farm.done,NULL);
+	
+	for (int a=0,p=0;a<grid.num_adders;a++)
+		for (int m=0;m<grid.num_multipliers;m++,p++) {
+			farm.points[p].adders = grid.adders[a];
+			farm.points[p].multipliers = grid.multipliers[m];
+			farm.points[p].status = PARETO_PENDING;
+		}
+	for (int i=1;i<farm.num_points;i++) {
+		pareto_point point = farm.points[i];
+		int j;
+		for (j=i;j>0 && farm.points[j-1].adders+farm.points[j-1].multipliers < point.adders+point.multipliers;j--)
+			farm.points[j] = farm.points[j-1];
+		farm.points[j] = point;
+	}
+	
+	for (int p=0;p<farm.num_points;p++) {
+		pareto_point *point = &farm.points[p];
+		
+		// critical path, and the cycles the units need for all operations
+		int lower_bound = final->asap_cycle;
+		if (unit_latency_bound(num_adds,ADD,point->adders) > lower_bound) lower_bound = unit_latency_bound(num_adds,ADD,point->adders);
+		if (unit_latency_bound(num_mults,MULT,point->multipliers) > lower_bound) lower_bound = unit_latency_bound(num_mults,MULT,point->multipliers);
+		
+		// wait for a free core, so the bounds are as tight as they get
+		pthread_mutex_lock(&farm.lock);
+		while (farm.running == num_threads) pthread_cond_wait(&farm.done,&farm.lock);
+		int settled = pareto_bound(&farm,point,lower_bound);
+		pthread_mutex_unlock(&farm.lock);
+		if (settled) continue;
+		
+		// the DAG is only touched by this thread: the solvers work on files
+		schedule_adders = point->adders;
+		schedule_multipliers = point->multipliers;
+		set_slack(layers,num_layers,layer_sizes[0],grid.slacks[0]);
+		
+		int heuristic = heuristic_schedule(layers,num_layers,layer_sizes[0],layer_sizes[num_layers-1]);
+		if (heuristic <= final->alap_cycle && (point->upper_bound < 0 || heuristic < point->upper_bound))
+			point->upper_bound = heuristic;
+		
+		if (point->upper_bound >= 0 && point->lower_bound >= point->upper_bound) {
+			point->latency = point->upper_bound;
+			point->status = PARETO_BOUNDS;
+			continue;
+		}
+		
+		// the LP only needs windows up to the best schedule known
+		if (point->upper_bound >= 0 && point->upper_bound < final->alap_cycle)
+			set_slack(layers,num_layers,layer_sizes[0],point->upper_bound - final->asap_cycle);
+		
+		argstype myargs;
+		snprintf(point->lp_filename,1024,"pareto_%d_%d.lp",point->adders,point->multipliers);
+		compute_functional_utilization(layers,num_layers,layer_sizes[0],layer_sizes[num_layers-1],&myargs);
+		generate_ilp_file(layers,num_layers,layer_sizes[0],layer_sizes[num_layers-1],point->lp_filename,&myargs);
+		free(myargs.add_use);
+		free(myargs.mult_use);
+		point->final_id = final->id;
+		
+		// the heuristic schedule is the MIP start
+		snprintf(point->start_filename,1024,"pareto_%d_%d.mst",point->adders,point->multipliers);
+		write_mip_start(layers,num_layers,point->start_filename);
+		
+		pthread_mutex_lock(&farm.lock);
+		farm.running++;
+		point->status = PARETO_RUNNING;
+		pthread_mutex_unlock(&farm.lock);
+		
+		pareto_instance *instance = (pareto_instance *)malloc(sizeof(pareto_instance));
+		instance->farm = &farm;
+		instance->point = point;
+		clock_gettime(CLOCK_MONOTONIC,&point->started);
+		if (pthread_create(&point->thread,NULL,pareto_worker,(void *)instance)) {
+			perror("Fatal: creating solver thread");
+			exit(1);
+		}
+	}
+	
+	for (int p=0;p<farm.num_points;p++)
+		if (farm.points[p].lp_filename[0]) pthread_join(farm.points[p].thread,NULL);
+	
+	pthread_mutex_destroy(&farm.lock);
+	pthread_cond_destroy(&farm.done);
+	
+	printf ("Pareto exploration (%d points, %d solver instances, slack %d, max_ii %d)\n"
+	        "------------------\n",farm.num_points,num_threads,grid.slacks[0],grid.max_iis[0]);
+	printf ("%8s%8s%8s%9s%12s%10s%8s\n","adders","mults","lower","latency","status","ms","front");
+	for (int p=0;p<farm.num_points;p++) {
+		pareto_point *point = &farm.points[p];
+		int on_front = PARETO_SCHEDULED(point);
+		
+		// on the front unless a smaller budget is at least as fast
+		for (int i=0;i<farm.num_points && on_front;i++) {
+			pareto_point *other = &farm.points[i];
+			if (other != point && PARETO_SCHEDULED(other) && PARETO_FEWER(other,point) &&
+				!PARETO_FEWER(point,other) && other->latency <= point->latency)
+				on_front = 0;
+		}
+		
+		printf ("%8d%8d%8d%9d%12s%10.1f%8s\n",point->adders,point->multipliers,point->lower_bound,
+				PARETO_SCHEDULED(point) ? point->latency : -1,pareto_status_names[point->status],
+				point->ms,on_front ? "*" : "");
+	}
+	
+	schedule_adders = saved_adders;
+	schedule_multipliers = saved_multipliers;
+	schedule_slack = saved_slack;
+	schedule_max_ii = saved_max_ii;
+	
+	free(farm.points);
+	free_dag(mydag);
+	free(layers);
+}
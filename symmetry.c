@@ -0,0 +1,206 @@
+#include "netscheduler.h"
+
+// neuron symmetry: the neurons of a layer are built identically, so
+// exchanging two of them, together with the multipliers of the next layer
+// that consume their outputs, maps every schedule onto another one of the
+// same latency.  the solver would have to branch through all of these
+// copies; instead, each exchange is ruled out by ordering the start times
+// of the two neurons' output nodes.
+//
+// two cases are recognized per layer: all neurons feed the very same
+// consumers (e.g. the output node), so any permutation is a symmetry and
+// the neurons are put in a chain; or every neuron of the next layer sums
+// the products in identically shaped adder trees, so two subtrees of an
+// adder can be exchanged whenever they have the same shape
+
+typedef struct {
+	dag *mydag;
+	node_idx *outputs;		// output node of each neuron of the layer
+	int *leaf_neuron;		// neuron whose product a leaf multiplier computes
+	uint64_t *shape;		// shape of each adder tree node (0 if unknown)
+	node_idx *map;			// tree node of the next neuron, per node of the first one
+	unsigned int *stamp;	// map[i] is valid when stamp[i] equals the current stamp
+	unsigned int current;
+	node_idx *pairs;
+	int count,max;
+} symmetry_search;
+
+static void add_pair (symmetry_search *s,node_idx first,node_idx second) {
+	// already implied by the windows
+	if (s->mydag->nodes[first].alap_cycle <= s->mydag->nodes[second].asap_cycle) return;
+	
+	if (s->count == s->max) {
+		s->max = s->max ? 2*s->max : 1024;
+		s->pairs = (node_idx *)realloc(s->pairs,sizeof(node_idx)*2*s->max);
+		if (!s->pairs) {
+			perror("Fatal: growing symmetry constraint list");
+			exit(1);
+		}
+	}
+	s->pairs[2*s->count] = first;
+	s->pairs[2*s->count+1] = second;
+	s->count++;
+}
+
+// the adder a tree node feeds, or NULL at the root of the tree
+static node *tree_parent (node *mynode) {
+	if (NUM_OUT_EDGES(mynode) != 1) return NULL;
+	
+	node *parent = OUT_NODE(mynode,0);
+	if (parent->type != ADD || NUM_IN_EDGES(parent) != 2 || parent->neuron != mynode->neuron || parent->layer != mynode->layer) return NULL;
+	
+	return parent;
+}
+
+// shape of a subtree, the same for any two subtrees that are mirror images
+static uint64_t tree_shape (symmetry_search *s,node *mynode) {
+	if (s->leaf_neuron[mynode->index] >= 0) return 1;
+	if (mynode->type != ADD || NUM_IN_EDGES(mynode) != 2) return 3 + mynode->index;	// matches no other subtree
+	if (s->shape[mynode->index]) return s->shape[mynode->index];
+	
+	uint64_t a = tree_shape(s,IN_NODE(mynode,0));
+	uint64_t b = tree_shape(s,IN_NODE(mynode,1));
+	if (a > b) {
+		uint64_t t = a;
+		a = b;
+		b = t;
+	}
+	
+	uint64_t hash = (a*0x9e3779b97f4a7c15ULL) ^ (b + 0x632be59bd9b4e019ULL + (a << 6) + (a >> 2));
+	return s->shape[mynode->index] = hash ? hash : 2;
+}
+
+// order the two subtrees of every adder whose subtrees have the same shape,
+// through the neuron of each subtree's canonical leaf, which is reached
+// through the lower shaped child (the first one, for equal shapes).
+// returns that leaf's neuron
+static int order_subtrees (symmetry_search *s,node *mynode) {
+	if (s->leaf_neuron[mynode->index] >= 0) return s->leaf_neuron[mynode->index];
+	if (mynode->type != ADD || NUM_IN_EDGES(mynode) != 2) return -1;
+	
+	node *first = IN_NODE(mynode,0);
+	node *second = IN_NODE(mynode,1);
+	int first_leaf = order_subtrees(s,first);
+	int second_leaf = order_subtrees(s,second);
+	
+	if (first_leaf >= 0 && second_leaf >= 0 && tree_shape(s,first) == tree_shape(s,second)) {
+		add_pair(s,s->outputs[first_leaf],s->outputs[second_leaf]);
+		return first_leaf;
+	}
+	
+	return tree_shape(s,second) < tree_shape(s,first) ? second_leaf : first_leaf;
+}
+
+// check that consumer k of every neuron sits in an adder tree of the same
+// form as consumer 0, with each neuron's product at the same place
+static int same_tree (symmetry_search *s,int num_neurons,int k) {
+	dag *mydag = s->mydag;
+	
+	s->current++;
+	for (int i=0;i<num_neurons;i++) {
+		node *first = OUT_NODE(&mydag->nodes[s->outputs[i]],0);
+		node *other = OUT_NODE(&mydag->nodes[s->outputs[i]],k);
+		
+		if (other->type != first->type || other->neuron != OUT_NODE(&mydag->nodes[s->outputs[0]],k)->neuron) return 0;
+		
+		while (first) {
+			if (s->stamp[first->index] == s->current) {
+				if (s->map[first->index] != other->index) return 0;
+				break;
+			}
+			s->stamp[first->index] = s->current;
+			s->map[first->index] = other->index;
+			
+			first = tree_parent(first);
+			other = tree_parent(other);
+			if (!first != !other) return 0;
+		}
+	}
+	
+	return 1;
+}
+
+static void layer_symmetry (symmetry_search *s,int layer) {
+	dag *mydag = s->mydag;
+	int num_neurons = mydag->layer_size[layer];
+	node_idx *outputs = s->outputs = mydag->layer_nodes[layer];
+	node *first = &mydag->nodes[outputs[0]];
+	int num_consumers = NUM_OUT_EDGES(first);
+	int same_consumers = 1;
+	
+	if (num_neurons < 2 || !num_consumers) return;
+	
+	for (int i=1;i<num_neurons;i++) {
+		node *mynode = &mydag->nodes[outputs[i]];
+		
+		if (mynode->type != first->type || NUM_OUT_EDGES(mynode) != num_consumers) return;
+		for (int k=0;k<num_consumers;k++)
+			if (OUT_EDGE(mynode,k).node_index != OUT_EDGE(first,k).node_index) same_consumers = 0;
+	}
+	
+	// all neurons are interchangeable
+	if (same_consumers) {
+		for (int i=1;i<num_neurons;i++) add_pair(s,outputs[i-1],outputs[i]);
+		return;
+	}
+	
+	// otherwise, each consumer must be a multiplier at the leaf of an adder tree
+	for (int i=0;i<num_neurons;i++) {
+		node *leaf = OUT_NODE(&mydag->nodes[outputs[i]],0);
+		
+		if (leaf->type != MULT || NUM_IN_EDGES(leaf) != 1 || !tree_parent(leaf)) return;
+		s->leaf_neuron[leaf->index] = i;
+	}
+	
+	for (int k=1;k<num_consumers;k++)
+		if (!same_tree(s,num_neurons,k)) return;
+	
+	node *root = OUT_NODE(first,0);
+	while (tree_parent(root)) root = tree_parent(root);
+	
+	order_subtrees(s,root);
+}
+
+// find the symmetry breaking constraints of the DAG's neurons.  each pair
+// (pairs[2i],pairs[2i+1]) of node indices asks for the first node not to
+// start later than the second; pairs that the ASAP/ALAP windows already
+// order are left out.  returns the number of pairs
+int neuron_symmetry_pairs (dag *mydag,node_idx **pairs) {
+	int n = mydag->num_nodes;
+	symmetry_search s;
+	
+	if (!mydag->csr_valid) build_csr(mydag);
+	
+	s.mydag = mydag;
+	s.leaf_neuron = (int *)malloc(sizeof(int)*(n ? n : 1));
+	s.shape = (uint64_t *)calloc(n ? n : 1,sizeof(uint64_t));
+	s.map = (node_idx *)malloc(sizeof(node_idx)*(n ? n : 1));
+	s.stamp = (unsigned int *)calloc(n ? n : 1,sizeof(unsigned int));
+	s.current = 0;
+	s.pairs = NULL;
+	s.count = s.max = 0;
+	
+	for (int i=0;i<n;i++) s.leaf_neuron[i] = -1;
+	
+	for (int l=0;l<mydag->num_layers;l++) {
+		int before = s.count;
+		
+		layer_symmetry(&s,l);
+		
+		// leaves are only marked for the layer at hand
+		for (int i=0;i<mydag->layer_size[l];i++) {
+			node *mynode = &mydag->nodes[mydag->layer_nodes[l][i]];
+			if (NUM_OUT_EDGES(mynode)) s.leaf_neuron[OUT_NODE(mynode,0)->index] = -1;
+		}
+		
+		if (s.count > before) logmsg("Layer %d: %d symmetry breaking constraints",l,s.count-before);
+	}
+	
+	free(s.leaf_neuron);
+	free(s.shape);
+	free(s.map);
+	free(s.stamp);
+	
+	*pairs = s.pairs;
+	return s.count;
+}
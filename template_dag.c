@@ -0,0 +1,517 @@
+#include "netscheduler.h"
+
+// every neuron of a layer has the same multiplier/adder subgraph and reads
+// every output of the previous layer, so a layer can be stored as one
+// neuron template plus a replication count.  all neurons of a layer share
+// the same ASAP times, and their ALAP times differ only by a per-neuron
+// offset, so timing, utilization, LP emission, the solution and its
+// register pressure never need the expanded DAG.  it's only expanded
+// (expand_template_network()) for what works on its nodes
+
+static void build_template (template_layer *mytemplate,int fan_in,layer_type type,int inc_bias,int inc_delta_multiplier) {
+	int sizes[] = {fan_in,1};
+	int max_nodes=1,max_edges=1;
+	node *layers[2] = {0,0};
+
+	// size the template body like a one-neuron network
+	if (type != INPUT_LAYER) count_network_nodes(2,sizes,inc_bias,inc_delta_multiplier,&max_nodes,&max_edges);
+
+	dag *body = create_dag(max_nodes,max_edges);
+	body->num_layers = 2;
+	body->layer_size = (int *)malloc(sizeof(int)*2);
+	body->layer_nodes = (node_idx **)malloc(sizeof(node_idx *)*2);
+
+	if (type == INPUT_LAYER) {
+		// input layer template is a single input node without ports
+		add_layer(body,layers,0,0,-1,1,INPUT_LAYER,inc_bias,inc_delta_multiplier);
+		body->num_layers = 1;
+		mytemplate->final_index = body->layer_nodes[0][0];
+	} else {
+		// ports first, then the neuron itself
+		int id = add_layer(body,layers,0,0,-1,fan_in,INPUT_LAYER,inc_bias,inc_delta_multiplier);
+		add_layer(body,layers,1,id,fan_in,1,type,inc_bias,inc_delta_multiplier);
+		mytemplate->final_index = body->layer_nodes[1][0];
+	}
+
+	build_csr(body);
+
+	mytemplate->type = type;
+	mytemplate->fan_in = fan_in;
+	mytemplate->neuron_size = body->num_nodes - fan_in;
+	mytemplate->body = body;
+	mytemplate->start_cycle = 0;
+	mytemplate->rel_asap = (int *)malloc(sizeof(int)*body->num_nodes);
+	mytemplate->rel_alap = (int *)malloc(sizeof(int)*body->num_nodes);
+	mytemplate->port_deadline = mytemplate->rel_alap;
+	mytemplate->neuron_alap = (int *)malloc(sizeof(int)*mytemplate->replication);
+}
+
+template_network *create_template_network (int num_layers,int *layer_sizes,int inc_bias,int inc_delta_multiplier) {
+	template_network *net = (template_network *)malloc(sizeof(template_network));
+
+	// same layering as create_basic_network_dag, including the final output
+	net->num_layers = num_layers+1;
+	net->layers = (template_layer *)malloc(sizeof(template_layer)*(num_layers+1));
+	net->num_nodes = 0;
+	net->scheduled_cycle = NULL;
+
+	for (int i=0;i<=num_layers;i++) {
+		template_layer *mytemplate = &net->layers[i];
+		layer_type type = i==0 ? INPUT_LAYER :
+						  i==num_layers ? OUTPUT_LAYER :
+						  NEURON_BINARY_ADD_LAYER;
+
+		mytemplate->replication = i==num_layers ? 1 : layer_sizes[i];
+		build_template(mytemplate,i ? layer_sizes[i-1] : 0,type,inc_bias,inc_delta_multiplier);
+
+		// ids are assigned exactly as in the expanded DAG
+		mytemplate->base_id = net->num_nodes;
+		net->num_nodes += mytemplate->replication * mytemplate->neuron_size;
+	}
+
+	return net;
+}
+
+void schedule_templates (template_network *net) {
+	int ready = 0;
+
+	// set asaps, layer by layer: all ports of a template are ready at the same time
+	for (int l=0;l<net->num_layers;l++) {
+		template_layer *mytemplate = &net->layers[l];
+		dag *body = mytemplate->body;
+		node_idx *order = topological_order(body);
+
+		for (int i=0;i<body->num_nodes;i++) {
+			node *mynode = &body->nodes[order[i]];
+			int asap = 0;
+
+			for (int j=0;j<NUM_IN_EDGES(mynode);j++) {
+				node *pred = IN_NODE(mynode,j);
+				if ((int)pred->index < mytemplate->fan_in) continue;
+
+				int latency = LATENCY(pred->type);
+				int t = mytemplate->rel_asap[pred->index] + latency;
+				if (t > asap) asap = t;
+			}
+			mytemplate->rel_asap[mynode->index] = asap;
+		}
+
+		mytemplate->start_cycle = ready;
+		int latency = LATENCY(body->nodes[mytemplate->final_index].type);
+		ready = TEMPLATE_ASAP(mytemplate,mytemplate->final_index) + latency;
+	}
+
+	// set alaps relative to each neuron's final node
+	for (int l=0;l<net->num_layers;l++) {
+		template_layer *mytemplate = &net->layers[l];
+		dag *body = mytemplate->body;
+		node_idx *order = topological_order(body);
+
+		for (int i=body->num_nodes-1;i>=0;i--) {
+			node *mynode = &body->nodes[order[i]];
+			int alap = 0,found = 0;
+
+			for (int j=0;j<NUM_OUT_EDGES(mynode);j++) {
+				int t = mytemplate->rel_alap[OUT_EDGE(mynode,j).node_index];
+				if (!found || t < alap) alap = t;
+				found = 1;
+			}
+
+			// ports store the cycle their value is needed by (port_deadline)
+			if ((int)mynode->index >= mytemplate->fan_in && mynode->index != mytemplate->final_index) {
+				int latency = LATENCY(mynode->type);
+				alap -= latency;
+			}
+
+			mytemplate->rel_alap[mynode->index] = alap;
+		}
+	}
+
+	// set latency slack
+	template_layer *last = &net->layers[net->num_layers-1];
+	last->neuron_alap[0] = TEMPLATE_ASAP(last,last->final_index) + schedule_slack;
+
+	// propagate alaps backward: final node j of a layer must be ready for
+	// port j of the earliest-deadline neuron of the next layer
+	for (int l=net->num_layers-1;l>0;l--) {
+		template_layer *mytemplate = &net->layers[l];
+		template_layer *prev = &net->layers[l-1];
+		int latency = LATENCY(prev->body->nodes[prev->final_index].type);
+
+		int min_alap = mytemplate->neuron_alap[0];
+		for (int i=1;i<mytemplate->replication;i++)
+			if (mytemplate->neuron_alap[i] < min_alap) min_alap = mytemplate->neuron_alap[i];
+
+		for (int j=0;j<prev->replication;j++)
+			prev->neuron_alap[j] = min_alap + mytemplate->port_deadline[j] - latency;
+	}
+
+	// set alaps for inputs, which will hopefully allow for II > 1 (experimental)
+	for (int i=0;i<net->layers[0].replication;i++) net->layers[0].neuron_alap[i] = schedule_max_ii;
+}
+
+static int compare_ints (const void *a,const void *b) {
+	return *(const int *)a - *(const int *)b;
+}
+
+void compute_template_utilization (template_network *net,argstype *myargs) {
+	template_layer *last = &net->layers[net->num_layers-1];
+
+	// assume this is a safe way to find the maximum possible latency
+	int max_latency = TEMPLATE_ALAP(last,0,last->final_index);
+
+	// allocate and initialize function unit usage counters, accumulated as
+	// differences and summed at the end
+	myargs->add_use = (int *)malloc(sizeof(int) * (max_latency+1));
+	myargs->mult_use = (int *)malloc(sizeof(int) * (max_latency+1));
+	for (int i=0;i<=max_latency;i++) {
+		myargs->add_use[i]=0;
+		myargs->mult_use[i]=0;
+	}
+
+	for (int l=0;l<net->num_layers;l++) {
+		template_layer *mytemplate = &net->layers[l];
+
+		// neurons of a layer only differ by their alap, which takes few
+		// distinct values, so count each distinct offset once
+		int *alaps = (int *)malloc(sizeof(int)*mytemplate->replication);
+		memcpy(alaps,mytemplate->neuron_alap,sizeof(int)*mytemplate->replication);
+		qsort(alaps,mytemplate->replication,sizeof(int),compare_ints);
+
+		for (int k=mytemplate->fan_in;k<mytemplate->body->num_nodes;k++) {
+			node_type type = mytemplate->body->nodes[k].type;
+			int *use = type == ADD ? myargs->add_use :
+					   type == MULT ? myargs->mult_use :
+					   NULL;
+			if (!use) continue;
+
+			int asap = TEMPLATE_ASAP(mytemplate,k);
+			for (int i=0;i<mytemplate->replication;) {
+				int j = i;
+				while (j<mytemplate->replication && alaps[j]==alaps[i]) j++;
+
+				int alap = alaps[i] + mytemplate->rel_alap[k];
+				if (alap >= asap) {
+					use[asap] += j-i;
+					if (alap+1 <= max_latency) use[alap+1] -= j-i;
+				}
+				i = j;
+			}
+		}
+
+		free(alaps);
+	}
+
+	// prefix sum the differences into per-cycle counts
+	for (int i=1;i<=max_latency;i++) {
+		myargs->add_use[i] += myargs->add_use[i-1];
+		myargs->mult_use[i] += myargs->mult_use[i-1];
+	}
+}
+
+static void emit_template_start_and_dependency_constraints (FILE *myFile,template_network *net,int l,int i,int k) {
+	template_layer *mytemplate = &net->layers[l];
+	node *mynode = &mytemplate->body->nodes[k];
+	int id = TEMPLATE_ID(mytemplate,i,k);
+	int asap = TEMPLATE_ASAP(mytemplate,k);
+	int alap = TEMPLATE_ALAP(mytemplate,i,k);
+
+	// add unique start time constraint
+	fprintf (myFile,"\\ start time constraint\n");
+	for (int c=asap;c<=alap;c++) {
+		if (c!=asap) fprintf (myFile," + ");
+		fprintf(myFile,"n_%d_c_%d",id,c);
+	}
+	fprintf (myFile," = 1\n");
+
+	// add data dependency constraints
+	fprintf (myFile,"\\ data dependency constraint\n");
+	for (int j=0;j<NUM_IN_EDGES(mynode);j++) {
+		node *pred = IN_NODE(mynode,j);
+		template_layer *pred_template = mytemplate;
+		int pred_neuron = i;
+		node_idx pred_k = pred->index;
+
+		// ports resolve to the final node of the matching previous-layer neuron
+		if ((int)pred_k < mytemplate->fan_in) {
+			pred_template = &net->layers[l-1];
+			pred_neuron = pred_k;
+			pred_k = pred_template->final_index;
+			pred = &pred_template->body->nodes[pred_k];
+		}
+
+		int pred_id = TEMPLATE_ID(pred_template,pred_neuron,pred_k);
+		int pred_asap = TEMPLATE_ASAP(pred_template,pred_k);
+		int pred_alap = TEMPLATE_ALAP(pred_template,pred_neuron,pred_k);
+
+		for (int c=asap;c<=alap;c++) {
+			if (c!=asap) fprintf (myFile," + ");
+			fprintf(myFile,"%d n_%d_c_%d",c,id,c);
+		}
+
+		for (int c=pred_asap;c<=pred_alap;c++) {
+			fprintf(myFile," - %d n_%d_c_%d",c,pred_id,c);
+		}
+
+		fprintf(myFile," >= %d\n",LATENCY(pred->type));
+	}
+}
+
+// neurons of a layer by descending alap offset, so the instances of a
+// template node whose window reaches a cycle come first
+static int *neuron_order (template_layer *mytemplate) {
+	int *order = (int *)malloc(sizeof(int)*mytemplate->replication);
+	
+	for (int i=0;i<mytemplate->replication;i++) {
+		int j;
+		for (j=i;j>0 && mytemplate->neuron_alap[order[j-1]] < mytemplate->neuron_alap[i];j--) order[j] = order[j-1];
+		order[j] = i;
+	}
+	
+	return order;
+}
+
+static void emit_template_resource_constraint (FILE *myFile,template_network *net,int **orders,int cycle,node_type type,int limit) {
+	int first = 1;
+
+	for (int l=0;l<net->num_layers;l++) {
+		template_layer *mytemplate = &net->layers[l];
+
+		for (int k=mytemplate->fan_in;k<mytemplate->body->num_nodes;k++) {
+			if (mytemplate->body->nodes[k].type != type) continue;
+			if (TEMPLATE_ASAP(mytemplate,k) > cycle) continue;
+
+			// visit only the neurons whose window covers this cycle
+			for (int n=0;n<mytemplate->replication && TEMPLATE_ALAP(mytemplate,orders[l][n],k) >= cycle;n++) {
+				// join variables with addition
+				if (!first) fprintf(myFile," + "); else first=0;
+				fprintf(myFile,"n_%d_c_%d",TEMPLATE_ID(mytemplate,orders[l][n],k),cycle);
+			}
+		}
+	}
+
+	if (!first) fprintf(myFile," <= %d\n",limit);
+}
+
+void generate_template_ilp_file (template_network *net,char *filename,argstype *myargs) {
+	template_layer *last = &net->layers[net->num_layers-1];
+	int last_cycle = TEMPLATE_ALAP(last,0,last->final_index);
+	FILE *myFile;
+	char str[1024];
+
+	if (OCCUPANCY(ADD) > 1 || OCCUPANCY(MULT) > 1) {
+		fprintf(stderr,"Fatal: the template ILP only models fully pipelined units.\n");
+		exit(1);
+	}
+	if (schedule_ii) {
+		fprintf(stderr,"Fatal: the template ILP has no modulo resource constraints (initiation interval %d).\n",schedule_ii);
+		exit(1);
+	}
+	if (schedule_formulation != ILP_TIME_INDEXED) {
+		fprintf(stderr,"Fatal: the template ILP only builds the time-indexed ILP formulation.\n");
+		exit(1);
+	}
+	if (schedule_registers != REGISTERS_NONE) {
+		fprintf(stderr,"Fatal: the template ILP has no register pressure objective.\n");
+		exit(1);
+	}
+
+	myFile=fopen(filename,"w+");
+	if (!myFile) {
+		snprintf(str,1024,"ERROR: opening \"%s\" for write",filename);
+		perror(str);
+		exit(1);
+	}
+
+	// add latency objective function
+	fprintf (myFile,"minimize\n\n");
+
+	int output_id = TEMPLATE_ID(last,0,last->final_index);
+	int earliest_completion = TEMPLATE_ASAP(last,last->final_index);
+	int latest_completion = last_cycle;
+	for (int i = earliest_completion;i<=latest_completion;i++) {
+		if (i!=earliest_completion) fprintf(myFile," + ");
+		fprintf (myFile,"%d n_%d_c_%d",i,output_id,i);
+	}
+	fprintf(myFile,"\n");
+
+	fprintf (myFile,"\nsubject to\n\n");
+
+	// define start time and dependency constraints, expanding each neuron
+	for (int l=0;l<net->num_layers;l++) {
+		template_layer *mytemplate = &net->layers[l];
+		for (int i=0;i<mytemplate->replication;i++)
+			for (int k=mytemplate->fan_in;k<mytemplate->body->num_nodes;k++)
+				emit_template_start_and_dependency_constraints(myFile,net,l,i,k);
+	}
+
+	fprintf (myFile,"\\ resource constraints\n");
+
+	// define resource constraint for each cycle where the units can be oversubscribed
+	int **orders = (int **)malloc(sizeof(int *)*net->num_layers);
+	for (int l=0;l<net->num_layers;l++) orders[l] = neuron_order(&net->layers[l]);
+	
+	for (int cycle = 0;cycle <= last_cycle;cycle++) {
+		if (myargs->mult_use[cycle] > schedule_multipliers)
+			emit_template_resource_constraint(myFile,net,orders,cycle,MULT,schedule_multipliers);
+		if (myargs->add_use[cycle] > schedule_adders)
+			emit_template_resource_constraint(myFile,net,orders,cycle,ADD,schedule_adders);
+	}
+	
+	for (int l=0;l<net->num_layers;l++) free(orders[l]);
+	free(orders);
+
+	// add declarations
+	fprintf (myFile,"\n\\ declarations\n");
+	fprintf (myFile,"\ninteger\n\n");
+
+	for (int l=0;l<net->num_layers;l++) {
+		template_layer *mytemplate = &net->layers[l];
+		for (int i=0;i<mytemplate->replication;i++)
+			for (int k=mytemplate->fan_in;k<mytemplate->body->num_nodes;k++)
+				for (int c=TEMPLATE_ASAP(mytemplate,k);c<=TEMPLATE_ALAP(mytemplate,i,k);c++)
+					fprintf(myFile,"n_%d_c_%d\n",TEMPLATE_ID(mytemplate,i,k),c);
+	}
+
+	fprintf (myFile,"\nend\n");
+
+	fclose(myFile);
+}
+
+// solve an LP file written by generate_template_ilp_file(), keeping the
+// start cycle of every instance by its id.  returns the latency,
+// SCHEDULE_INFEASIBLE or SCHEDULE_UNSOLVED, as solve_schedule() does
+int solve_template_schedule (template_network *net,char *filename) {
+	template_layer *last = &net->layers[net->num_layers-1];
+	int *ids,*cycles;
+	
+	schedule_status = run_solver(filename,NULL,NULL);
+	int count = read_solution(filename,&ids,&cycles);
+	
+	net->scheduled_cycle = (int *)realloc(net->scheduled_cycle,sizeof(int)*net->num_nodes);
+	for (int i=0;i<net->num_nodes;i++) net->scheduled_cycle[i] = -1;
+	
+	for (int i=0;i<count;i++) {
+		if (ids[i] < 0 || ids[i] >= net->num_nodes) {
+			fprintf(stderr,"Fatal: solution refers to unknown node id %d.\n",ids[i]);
+			exit(1);
+		}
+		net->scheduled_cycle[ids[i]] = cycles[i];
+	}
+	free(ids);
+	free(cycles);
+	
+	if (!count) {
+		if (schedule_status != SOLVER_INFEASIBLE) schedule_status = SOLVER_UNSOLVED;
+		return schedule_status == SOLVER_INFEASIBLE ? SCHEDULE_INFEASIBLE : SCHEDULE_UNSOLVED;
+	}
+	if (schedule_status != SOLVER_OPTIMAL) schedule_status = SOLVER_FEASIBLE;
+	
+	return net->scheduled_cycle[TEMPLATE_ID(last,0,last->final_index)];
+}
+
+// peak and summed register usage of the solved schedule, as
+// register_pressure() counts them on the expanded DAG.  the consumers of
+// neuron i's final node are the successors of port i in every neuron of
+// the next layer
+void template_register_pressure (template_network *net,int *peak,long *sum) {
+	int *start = net->scheduled_cycle;
+	int max_cycle=0;
+	
+	for (int l=0;l<net->num_layers;l++) {
+		template_layer *mytemplate = &net->layers[l];
+		for (int i=0;i<mytemplate->replication;i++)
+			for (int k=mytemplate->fan_in;k<mytemplate->body->num_nodes;k++) {
+				int finish = start[TEMPLATE_ID(mytemplate,i,k)] + LATENCY(mytemplate->body->nodes[k].type);
+				if (finish > max_cycle) max_cycle = finish;
+			}
+	}
+	
+	int *live = (int *)calloc(max_cycle+2,sizeof(int));
+	*sum = 0;
+	for (int l=0;l<net->num_layers;l++) {
+		template_layer *mytemplate = &net->layers[l];
+		template_layer *next = l+1 < net->num_layers ? &net->layers[l+1] : NULL;
+		
+		for (int i=0;i<mytemplate->replication;i++)
+			for (int k=mytemplate->fan_in;k<mytemplate->body->num_nodes;k++) {
+				node *mynode = &mytemplate->body->nodes[k];
+				int first = start[TEMPLATE_ID(mytemplate,i,k)] + LATENCY(mynode->type);
+				int last=-1;
+				
+				for (int j=0;j<NUM_OUT_EDGES(mynode);j++) {
+					int c = start[TEMPLATE_ID(mytemplate,i,OUT_EDGE(mynode,j).node_index)];
+					if (c > last) last = c;
+				}
+				if (next && (node_idx)k == mytemplate->final_index) {
+					node *port = &next->body->nodes[i];
+					
+					for (int j=0;j<NUM_OUT_EDGES(port);j++)
+						for (int n=0;n<next->replication;n++) {
+							int c = start[TEMPLATE_ID(next,n,OUT_EDGE(port,j).node_index)];
+							if (c > last) last = c;
+						}
+				}
+				
+				if (last <= first) continue;
+				live[first]++;
+				live[last]--;
+				*sum += last - first;
+			}
+	}
+	
+	*peak = 0;
+	for (int c=0,registers=0;c<=max_cycle;c++) {
+		registers += live[c];
+		if (registers > *peak) *peak = registers;
+	}
+	
+	free(live);
+}
+
+// ADD and MULT instances of the network
+void count_template_operations (template_network *net,int *num_adds,int *num_mults) {
+	*num_adds = *num_mults = 0;
+	
+	for (int l=0;l<net->num_layers;l++) {
+		template_layer *mytemplate = &net->layers[l];
+		for (int k=mytemplate->fan_in;k<mytemplate->body->num_nodes;k++) {
+			if (mytemplate->body->nodes[k].type == ADD) *num_adds += mytemplate->replication;
+			if (mytemplate->body->nodes[k].type == MULT) *num_mults += mytemplate->replication;
+		}
+	}
+}
+
+// build the full DAG of the network, with the template timing and (once
+// solved) the schedule expanded onto it.  node ids match the template
+// instance ids
+node **expand_template_network (template_network *net,int num_layers,int *layer_sizes,int inc_bias,int inc_delta_multiplier) {
+	node **layers = create_basic_network_dag(num_layers,layer_sizes,inc_bias,inc_delta_multiplier);
+	dag *mydag = layers[0]->graph;
+
+	if (mydag->num_nodes != net->num_nodes) {
+		fprintf(stderr,"Fatal: template network has %d nodes but the DAG has %d.\n",net->num_nodes,mydag->num_nodes);
+		exit(1);
+	}
+
+	for (int l=0;l<net->num_layers;l++) {
+		template_layer *mytemplate = &net->layers[l];
+		for (int i=0;i<mytemplate->replication;i++)
+			for (int k=mytemplate->fan_in;k<mytemplate->body->num_nodes;k++) {
+				int id = TEMPLATE_ID(mytemplate,i,k);
+				node *mynode = node_by_id(mydag,id);
+				
+				if (!mynode) {
+					fprintf(stderr,"Fatal: the DAG has no node for template instance id %d.\n",id);
+					exit(1);
+				}
+				mynode->asap_cycle = TEMPLATE_ASAP(mytemplate,k);
+				mynode->alap_cycle = TEMPLATE_ALAP(mytemplate,i,k);
+				if (net->scheduled_cycle) mynode->scheduled_cycle = net->scheduled_cycle[id];
+			}
+	}
+	
+	mydag->timed = 1;
+	
+	return layers;
+}